@@ -0,0 +1,287 @@
+/******************************************************************************
+**
+** File: bench_scheduler.c
+**
+** Description: Host benchmark & stress test for the scheduler. Builds
+** scheduler.c with UNIT_TEST_MODE and drives it a tick at a time with
+** _rtcISR() & scheduleDueTasks(), with a random mix of register, schedule,
+** unschedule & deregister calls across a pool of task IDs much larger than
+** the task table. Checks every task runs on the tick it was due, then
+** reports ops/sec, the dispatch latency distribution & memory used.
+**
+** Exits non-zero if a check fails or we fall below the thresholds.
+**
+** Usage: bench_scheduler [min ops/sec]
+**
+******************************************************************************/
+#define _POSIX_C_SOURCE         199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "scheduler.h"
+#include "schederr.h"
+
+/*
+** The pool of task IDs we churn through, the scheduler can only hold
+** SCHED_MAX_TASKS (max 64) of them at once...
+*/
+#define BENCH_TASK_POOL             512
+#define BENCH_TASK_ID_BASE          0x1000
+#define BENCH_TICKS                 200000
+#define BENCH_OPS_PER_TICK          8
+#define BENCH_MAX_DELAY             20
+
+/*
+** Defaults for the regression thresholds, a host TASKDESC is 40 bytes
+** with 64-bit pointers...
+*/
+#define BENCH_MIN_OPS_PER_SEC       500000.0
+#define BENCH_MAX_MEMORY            (64 * 40)
+
+typedef struct {
+    uint16_t            ID;
+    bool                isRegistered;
+    bool                isScheduled;
+    bool                isPeriodic;
+    rtc_t               period;
+    rtc_t               dueTime;
+    uint32_t            runCount;
+}
+bench_task_t;
+
+static bench_task_t     tasks[BENCH_TASK_POOL];
+static int              liveCount = 0;
+static unsigned int     lastError = 0;
+static uint32_t         earlyCount = 0;
+static uint32_t         lateCount = 0;
+static uint32_t         strayCount = 0;
+static uint32_t         runTotal = 0;
+
+void handleError(unsigned int code) {
+    lastError = code;
+}
+
+static void benchTask(PTASKPARM p) {
+    bench_task_t *      t = (bench_task_t *)p;
+    rtc_t               now = getRTCClock();
+
+    runTotal++;
+
+    if (!t->isRegistered || !t->isScheduled) {
+        strayCount++;
+        return;
+    }
+
+    if (now < t->dueTime) {
+        earlyCount++;
+    }
+    else if (now > t->dueTime) {
+        lateCount++;
+    }
+
+    t->runCount++;
+
+    if (t->isPeriodic) {
+        t->dueTime += t->period;
+    }
+    else {
+        t->isScheduled = false;
+    }
+}
+
+static void benchSchedule(bench_task_t * t) {
+    t->period = 1 + (rand() % BENCH_MAX_DELAY);
+    t->isPeriodic = ((rand() % 4) == 0);
+    t->dueTime = getRTCClock() + t->period;
+    t->isScheduled = true;
+
+    scheduleTask(t->ID, t->period, t->isPeriodic, t);
+}
+
+/*
+** One random operation on a random task from the pool...
+*/
+static void benchRandomOp(void) {
+    bench_task_t *      t = &tasks[rand() % BENCH_TASK_POOL];
+
+    if (!t->isRegistered) {
+        if (liveCount < SCHED_MAX_TASKS) {
+            registerTask(t->ID, &benchTask);
+            setTaskPriority(t->ID, (uint8_t)(rand() % TASK_NUM_PRIORITIES));
+
+            t->isRegistered = true;
+            liveCount++;
+
+            benchSchedule(t);
+        }
+        return;
+    }
+
+    switch (rand() % 4) {
+        case 0:
+            deregisterTask(t->ID);
+
+            t->isRegistered = false;
+            t->isScheduled = false;
+            liveCount--;
+            break;
+
+        case 1:
+            unscheduleTask(t->ID);
+            t->isScheduled = false;
+            break;
+
+        default:
+            benchSchedule(t);
+            break;
+    }
+}
+
+/*
+** The table is full, so one more registration must be refused...
+*/
+static bool benchCheckTableFull(void) {
+    int                 i;
+
+    for (i = 0;i < BENCH_TASK_POOL;i++) {
+        if (!tasks[i].isRegistered) {
+            lastError = 0;
+            registerTask(tasks[i].ID, &benchTask);
+
+            return (lastError == ERROR_SCHED_NOFREETASKS);
+        }
+    }
+
+    return false;
+}
+
+static int benchPercentileBucket(const SCHED_STATS * stats, uint32_t total, int percent) {
+    uint32_t            count = 0;
+    int                 i;
+
+    for (i = 0;i < SCHED_LATENCY_BUCKETS;i++) {
+        count += stats->latencyHistogram[i];
+
+        if ((uint64_t)count * 100 >= (uint64_t)total * percent) {
+            return i;
+        }
+    }
+
+    return SCHED_LATENCY_BUCKETS - 1;
+}
+
+int main(int argc, char ** argv) {
+    struct timespec     start;
+    struct timespec     end;
+    SCHED_STATS         stats;
+    double              seconds;
+    double              opsPerSec;
+    double              minOpsPerSec = BENCH_MIN_OPS_PER_SEC;
+    uint64_t            ops = 0;
+    uint32_t            histTotal = 0;
+    int                 i;
+    int                 j;
+    bool                isFail = false;
+
+    if (argc > 1) {
+        minOpsPerSec = atof(argv[1]);
+    }
+
+    srand(1);
+
+    initScheduler(SCHED_MAX_TASKS);
+
+    for (i = 0;i < BENCH_TASK_POOL;i++) {
+        tasks[i].ID = BENCH_TASK_ID_BASE + i;
+    }
+
+    /*
+    ** Fill the table first...
+    */
+    while (liveCount < SCHED_MAX_TASKS) {
+        benchRandomOp();
+    }
+
+    if (!benchCheckTableFull()) {
+        printf("FAIL: registering past SCHED_MAX_TASKS was not refused\n");
+        isFail = true;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0;i < BENCH_TICKS;i++) {
+        _rtcISR();
+        scheduleDueTasks();
+
+        for (j = 0;j < BENCH_OPS_PER_TICK;j++) {
+            benchRandomOp();
+        }
+
+        ops += BENCH_OPS_PER_TICK;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    opsPerSec = (double)(ops + runTotal) / seconds;
+
+    getSchedulerStats(&stats);
+
+    for (i = 0;i < SCHED_LATENCY_BUCKETS;i++) {
+        histTotal += stats.latencyHistogram[i];
+    }
+
+    printf("Tasks:       %d IDs over %d slots\n", BENCH_TASK_POOL, SCHED_MAX_TASKS);
+    printf("Ticks:       %d\n", BENCH_TICKS);
+    printf("API ops:     %llu\n", (unsigned long long)ops);
+    printf("Task runs:   %u\n", runTotal);
+    printf("Ops/sec:     %.0f (min %.0f)\n", opsPerSec, minOpsPerSec);
+    printf("Memory:      %u bytes (max %d)\n", stats.memoryUsed, BENCH_MAX_MEMORY);
+    printf("Latency:     p50 < %u us, p99 < %u us, max < %u us\n",
+                1U << benchPercentileBucket(&stats, histTotal, 50),
+                1U << benchPercentileBucket(&stats, histTotal, 99),
+                1U << benchPercentileBucket(&stats, histTotal, 100));
+    printf("Early/late:  %u/%u, stray runs %u\n", earlyCount, lateCount, strayCount);
+
+    if (earlyCount || lateCount || strayCount) {
+        printf("FAIL: tasks ran off schedule\n");
+        isFail = true;
+    }
+    if (stats.taskCount != (uint32_t)liveCount) {
+        printf("FAIL: scheduler has %u tasks, expected %d\n", stats.taskCount, liveCount);
+        isFail = true;
+    }
+    if (stats.memoryUsed > BENCH_MAX_MEMORY) {
+        printf("FAIL: task table is larger than %d bytes\n", BENCH_MAX_MEMORY);
+        isFail = true;
+    }
+    if (opsPerSec < minOpsPerSec) {
+        printf("FAIL: below %.0f ops/sec\n", minOpsPerSec);
+        isFail = true;
+    }
+
+    /*
+    ** Everything must deregister cleanly...
+    */
+    for (i = 0;i < BENCH_TASK_POOL;i++) {
+        if (tasks[i].isRegistered) {
+            deregisterTask(tasks[i].ID);
+        }
+    }
+
+    getSchedulerStats(&stats);
+
+    if (stats.taskCount != 0) {
+        printf("FAIL: %u tasks left after deregistering all\n", stats.taskCount);
+        isFail = true;
+    }
+
+    printf("%s\n", isFail ? "FAILED" : "PASSED");
+
+    return (isFail ? 1 : 0);
+}
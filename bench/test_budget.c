@@ -0,0 +1,180 @@
+/******************************************************************************
+**
+** File: test_budget.c
+**
+** Description: Host test of the energy budget controller. Drives
+** budgetUpdate() with a simulated battery through several days of sun
+** & night, with the scheduler clock advanced by _rtcISRTicks(), and
+** checks:
+**
+**  - a full battery reports at the standard interval with all sensors
+**  - with a marginal battery, the interval is stretched & the SOC is
+**    kept above the target we aim to have left at dawn
+**  - an empty battery drops to the longest interval & minimal sensors
+**  - after budgetReset(), the SOC lost while asleep (with the clock
+**    stopped) isn't learnt as the cost of a report
+**
+******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+#include "rtc_rp2040.h"
+#include "budget.h"
+
+#define TEST_DAYS                   6
+#define TEST_SUN_START_HOUR         8
+#define TEST_SUN_END_HOUR           16
+
+/*
+** The simulated battery, in % & %/hr...
+*/
+#define TEST_START_SOC              30.0
+#define TEST_SOLAR_CHARGE           5.0
+#define TEST_BASE_DRAIN             0.05
+#define TEST_REPORT_COST            0.1
+
+#define TEST_STANDARD_INTERVAL_MS   (4U * 60U * 1000U)
+#define TEST_LONGEST_INTERVAL_MS    (120U * 60U * 1000U)
+
+static bool                 isFail = false;
+
+void handleError(unsigned int code) {
+}
+
+static void _check(bool isOK, const char * msg) {
+    if (!isOK) {
+        printf("FAIL: %s\n", msg);
+        isFail = true;
+    }
+}
+
+static void _advanceMinutes(uint32_t minutes) {
+    _rtcISRTicks((uint32_t)(rtc_val_min(minutes)));
+}
+
+static void _update(double soc, bool isCharging) {
+    budgetUpdate((uint16_t)(soc * 256.0), (int16_t)(isCharging ? 100 : -50));
+}
+
+/*
+** Run the battery through the days, reading the gauge once per report...
+*/
+static void _testDayNight(void) {
+    double          soc = TEST_START_SOC;
+    double          minSOC = 100.0;
+    double          intervalMins;
+    uint32_t        longest = 0;
+    uint32_t        sinceReport = 0;
+    uint32_t        interval;
+    int             minute;
+    int             hour;
+    bool            isSun;
+
+    for (minute = 0;minute < TEST_DAYS * 24 * 60;minute++) {
+        hour = (minute / 60) % 24;
+        isSun = (hour >= TEST_SUN_START_HOUR && hour < TEST_SUN_END_HOUR);
+
+        interval = budgetGetReportInterval();
+        intervalMins = (double)interval / 60000.0;
+
+        soc += ((isSun ? TEST_SOLAR_CHARGE : 0.0) - TEST_BASE_DRAIN - TEST_REPORT_COST * 60.0 / intervalMins) / 60.0;
+
+        if (soc > 100.0) {
+            soc = 100.0;
+        }
+
+        _advanceMinutes(1);
+
+        if (++sinceReport >= (uint32_t)intervalMins) {
+            _update(soc, isSun);
+            sinceReport = 0;
+        }
+
+        /*
+        ** Skip the first day while it learns...
+        */
+        if (minute >= 24 * 60) {
+            if (soc < minSOC) {
+                minSOC = soc;
+            }
+            if (interval > longest) {
+                longest = interval;
+            }
+        }
+    }
+
+    printf("Day/night:   min SOC %.1f%%, longest interval %u min\n", minSOC, longest / 60000U);
+
+    _check(minSOC >= (double)BUDGET_TARGET_MIN_SOC, "SOC fell below the dawn target");
+    _check(longest > TEST_STANDARD_INTERVAL_MS, "interval never stretched");
+}
+
+static void _testFull(void) {
+    int             i;
+
+    for (i = 0;i < 30;i++) {
+        _advanceMinutes(4);
+        _update(95.0, true);
+    }
+
+    printf("Full:        interval %u min, level %d\n", budgetGetReportInterval() / 60000U, (int)budgetGetSensorLevel());
+
+    _check(budgetGetReportInterval() == TEST_STANDARD_INTERVAL_MS, "full battery not at the standard interval");
+    _check(budgetGetSensorLevel() == BUDGET_LEVEL_FULL, "full battery not at BUDGET_LEVEL_FULL");
+}
+
+static void _testEmpty(void) {
+    int             i;
+
+    for (i = 0;i < 30;i++) {
+        _advanceMinutes(4);
+        _update((double)BUDGET_TARGET_MIN_SOC - 5.0, false);
+    }
+
+    printf("Empty:       interval %u min, level %d\n", budgetGetReportInterval() / 60000U, (int)budgetGetSensorLevel());
+
+    _check(budgetGetReportInterval() == TEST_LONGEST_INTERVAL_MS, "empty battery not at the longest interval");
+    _check(budgetGetSensorLevel() == BUDGET_LEVEL_MINIMAL, "empty battery not at BUDGET_LEVEL_MINIMAL");
+}
+
+/*
+** 72 hours asleep costs a few % of SOC but the scheduler clock only
+** moves on by the time it takes to wake & read the gauge...
+*/
+static void _testSleep(void) {
+    uint32_t        afterReset;
+    uint32_t        withoutReset;
+
+    _testFull();
+
+    _advanceMinutes(2);
+    budgetReset();
+    _update(85.0, false);
+
+    afterReset = budgetGetReportInterval();
+
+    _advanceMinutes(4);
+    _update(85.0, false);
+    _advanceMinutes(2);
+    _update(75.0, false);
+
+    withoutReset = budgetGetReportInterval();
+
+    printf("Sleep:       interval %u min after budgetReset(), %u min without\n", afterReset / 60000U, withoutReset / 60000U);
+
+    _check(afterReset == TEST_STANDARD_INTERVAL_MS, "SOC lost asleep was learnt as report cost");
+    _check(withoutReset > TEST_STANDARD_INTERVAL_MS, "the same drop without budgetReset() went unnoticed");
+}
+
+int main(void) {
+    _testDayNight();
+    _testSleep();
+    _testEmpty();
+
+    printf("%s\n", isFail ? "FAILED" : "PASSED");
+
+    return (isFail ? 1 : 0);
+}
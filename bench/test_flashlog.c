@@ -0,0 +1,398 @@
+/******************************************************************************
+**
+** File: test_flashlog.c
+**
+** Description: Host test of the flash log, on the simulated flash from
+** flash_rp2040.c. Covers appending & uploading, records only being marked
+** as uploaded once the base station ACKs them, rescanning the log after
+** a reboot, a record torn by a power failure, wrapping round the ring,
+** the ages reported across a reset or sleep, and that every sector is
+** erased equally often.
+**
+******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "rtc_rp2040.h"
+#include "radio.h"
+#include "packet.h"
+#include "flash_rp2040.h"
+#include "flashlog.h"
+
+#define TEST_RECORDS_PER_SECTOR     (FLASH_SECTOR_SIZE / FLASHLOG_RECORD_SIZE)
+#define TEST_WRAP_COUNT             5
+#define TEST_AGE_UNKNOWN            0xFFFFFFFF
+#define TEST_OUTAGE_COUNT           20
+
+/*
+** The packets handed to the radio, the live & log packets are both
+** RADIO_PACKET_LENGTH...
+*/
+#define TEST_MAX_SENT               (FLASHLOG_RECORD_COUNT * 2)
+
+static weather_log_packet_t sent[TEST_MAX_SENT];
+static int                  sentCount = 0;
+static int                  queueSpace = 0;
+
+/*
+** The tags queued in this send, all ACKed unless the base station is down...
+*/
+static uint16_t             queuedTags[RADIO_QUEUE_LENGTH];
+static int                  queuedCount = 0;
+static bool                 isBaseStationUp = true;
+
+static bool                 isFail = false;
+
+void handleError(unsigned int code) {
+}
+
+int radioQueueAckPacket(uint8_t * buf, int length, uint16_t tag) {
+    if (queueSpace == 0 || sentCount >= TEST_MAX_SENT || queuedCount >= RADIO_QUEUE_LENGTH) {
+        return -1;
+    }
+
+    memcpy(&sent[sentCount++], buf, length);
+    queuedTags[queuedCount++] = tag;
+    queueSpace--;
+
+    return 0;
+}
+
+int radioGetAckedTags(uint16_t * tags, int maxCount) {
+    int                 i;
+
+    if (!isBaseStationUp) {
+        return 0;
+    }
+
+    for (i = 0;i < queuedCount && i < maxCount;i++) {
+        tags[i] = queuedTags[i];
+    }
+
+    return i;
+}
+
+static void _check(bool isOK, const char * msg) {
+    if (!isOK) {
+        printf("FAIL: %s\n", msg);
+        isFail = true;
+    }
+}
+
+static uint32_t _getSequence(const weather_log_packet_t * p) {
+    return (uint32_t)p->sequence[0] | ((uint32_t)p->sequence[1] << 8) | ((uint32_t)p->sequence[2] << 16);
+}
+
+/*
+** One send, as the sensor task does it: the live packet if there is one,
+** then the backlog with the room left, then confirm what was ACKed...
+*/
+static int _send(bool isLive, int backlogCount) {
+    weather_packet_t    w;
+    int                 count = 0;
+
+    queuedCount = 0;
+    queueSpace = RADIO_QUEUE_LENGTH - 1;
+
+    if (isLive) {
+        memset(&w, 0, sizeof(weather_packet_t));
+        w.packetID = PACKET_ID_WEATHER;
+
+        if (flashLogSendLive((uint8_t *)&w, sizeof(weather_packet_t)) == 0) {
+            count++;
+        }
+    }
+
+    if (backlogCount > queueSpace) {
+        backlogCount = queueSpace;
+    }
+
+    count += flashLogUpload(backlogCount);
+
+    flashLogConfirm();
+
+    return count;
+}
+
+static int _upload(int count) {
+    return _send(false, count);
+}
+
+static void _append(int16_t temperature) {
+    weather_packet_t    w;
+
+    memset(&w, 0, sizeof(weather_packet_t));
+    w.rawTemperature = temperature;
+
+    if (flashLogAppend(&w)) {
+        _check(false, "append failed");
+    }
+}
+
+/*
+** Upload everything pending, checking it comes out oldest first...
+*/
+static int _drain(void) {
+    int                 first = sentCount;
+    int                 i;
+
+    while (flashLogGetPendingCount() > 0) {
+        if (_upload(FLASHLOG_UPLOAD_BATCH) == 0) {
+            _check(false, "pending records would not upload");
+            break;
+        }
+    }
+
+    for (i = first + 1;i < sentCount;i++) {
+        if (_getSequence(&sent[i]) <= _getSequence(&sent[i - 1])) {
+            _check(false, "records uploaded out of order");
+            break;
+        }
+    }
+
+    return sentCount - first;
+}
+
+static void _testAppendAndReboot(void) {
+    int                 i;
+
+    flashSimReset();
+    flashLogInit();
+
+    for (i = 0;i < 100;i++) {
+        _append((int16_t)i);
+    }
+
+    _check(flashLogGetPendingCount() == 100, "append: pending count");
+
+    flashLogInit();
+    _check(flashLogGetPendingCount() == 100, "reboot: pending count not rescanned");
+
+    sentCount = 0;
+    _check(_upload(2) == 2, "upload: batch not queued");
+    _check(_getSequence(&sent[0]) == 0 && _getSequence(&sent[1]) == 1, "upload: not oldest first");
+    _check(sent[1].rawTemperature == 1, "upload: wrong reading");
+
+    /*
+    ** A full radio queue stops the upload, nothing is marked as sent...
+    */
+    _check(_upload(0) == 0 && flashLogGetPendingCount() == 98, "upload: sent with the queue full");
+
+    flashLogInit();
+    _check(flashLogGetPendingCount() == 98, "reboot: uploaded records still pending");
+
+    _upload(1);
+    _check(_getSequence(&sent[2]) == 2, "reboot: tail not rescanned");
+
+    /*
+    ** A live reading the base station ACKs is marked as uploaded...
+    */
+    _append(100);
+    _send(true, 0);
+    flashLogInit();
+    _check(flashLogGetPendingCount() == 97, "live reading left pending after the ACK");
+
+    printf("Append:      %u pending after 2 reboots\n", flashLogGetPendingCount());
+}
+
+/*
+** With the base station down nothing is ACKed, so every reading must
+** still be pending when it comes back, & go up in order...
+*/
+static void _testOutage(void) {
+    uint32_t            pending;
+    int                 first;
+    int                 i;
+    int                 j;
+
+    flashSimReset();
+    flashLogInit();
+
+    isBaseStationUp = false;
+    sentCount = 0;
+
+    for (i = 0;i < TEST_OUTAGE_COUNT;i++) {
+        _append((int16_t)i);
+        _send(true, FLASHLOG_UPLOAD_BATCH);
+    }
+
+    pending = flashLogGetPendingCount();
+    flashLogInit();
+
+    _check(pending == TEST_OUTAGE_COUNT, "outage: readings lost while the base station was down");
+    _check(flashLogGetPendingCount() == pending, "outage: pending count differs after reboot");
+
+    isBaseStationUp = true;
+
+    /*
+    ** The live reading mustn't go again as part of the backlog...
+    */
+    _append(TEST_OUTAGE_COUNT);
+
+    first = sentCount;
+    _send(true, FLASHLOG_UPLOAD_BATCH);
+
+    for (i = first;i < sentCount;i++) {
+        for (j = i + 1;j < sentCount;j++) {
+            if (queuedTags[i - first] == queuedTags[j - first]) {
+                _check(false, "outage: record queued twice in one send");
+            }
+        }
+    }
+
+    _check(flashLogGetPendingCount() == TEST_OUTAGE_COUNT - FLASHLOG_UPLOAD_BATCH, "outage: ACKed records still pending");
+
+    first = sentCount;
+    _drain();
+
+    _check(_getSequence(&sent[first]) == FLASHLOG_UPLOAD_BATCH, "outage: backlog not resumed from the oldest");
+    _check(_getSequence(&sent[sentCount - 1]) == TEST_OUTAGE_COUNT - 1, "outage: newest backlog record lost");
+
+    flashLogInit();
+    _check(flashLogGetPendingCount() == 0, "outage: pending after draining");
+
+    printf("Outage:      %u readings held & uploaded once ACKed\n", pending);
+}
+
+static void _testTornWrite(void) {
+    weather_packet_t    w;
+    uint32_t            pending = flashLogGetPendingCount();
+
+    memset(&w, 0, sizeof(weather_packet_t));
+
+    flashSimSetFailAfter(10);
+    flashLogAppend(&w);
+    flashSimSetFailAfter(-1);
+
+    flashLogInit();
+    _check(flashLogGetPendingCount() == pending, "torn write: torn record counted");
+
+    _append(200);
+    flashLogInit();
+    _check(flashLogGetPendingCount() == pending + 1, "torn write: next append lost");
+
+    _drain();
+    _check(sent[sentCount - 1].rawTemperature == 200, "torn write: last reading not uploaded");
+
+    printf("Torn write:  skipped, %u pending after upload\n", flashLogGetPendingCount());
+}
+
+/*
+** Fill the ring several times over, with only one in three readings
+** left pending, only the newest records survive & every sector wears
+** equally...
+*/
+static void _testWrapAndWear(void) {
+    uint32_t            minErase = 0xFFFFFFFF;
+    uint32_t            maxErase = 0;
+    uint32_t            count;
+    uint32_t            pending;
+    uint32_t            lastPending = 0;
+    uint32_t            i;
+    int                 first;
+    int                 n;
+
+    flashSimReset();
+    flashLogInit();
+
+    for (i = 0;i < FLASHLOG_RECORD_COUNT * TEST_WRAP_COUNT;i++) {
+        _append((int16_t)i);
+
+        if ((i % 3) == 0) {
+            lastPending = i;
+        }
+        else {
+            sentCount = 0;
+            _send(true, 0);
+        }
+
+        if ((i % 997) == 0) {
+            flashLogInit();
+        }
+    }
+
+    pending = flashLogGetPendingCount();
+    flashLogInit();
+
+    _check(flashLogGetPendingCount() == pending, "wrap: pending count differs after reboot");
+    _check(pending <= FLASHLOG_RECORD_COUNT / 3 + 1, "wrap: too many pending");
+    _check(pending >= (FLASHLOG_RECORD_COUNT - TEST_RECORDS_PER_SECTOR) / 3, "wrap: too few pending");
+
+    sentCount = 0;
+    first = sentCount;
+    n = _drain();
+
+    _check(n == (int)pending, "wrap: upload count");
+    _check(_getSequence(&sent[first + n - 1]) == lastPending, "wrap: newest record lost");
+
+    flashLogInit();
+    _check(flashLogGetPendingCount() == 0, "wrap: pending after draining");
+
+    for (i = 0;i < FLASHLOG_SECTOR_COUNT;i++) {
+        count = flashSimGetEraseCount(FLASHLOG_OFFSET + i * FLASH_SECTOR_SIZE);
+
+        if (count < minErase) {
+            minErase = count;
+        }
+        if (count > maxErase) {
+            maxErase = count;
+        }
+    }
+
+    printf("Wrap:        %u pending, uploaded in order\n", pending);
+    printf("Wear:        %u - %u erases per sector\n", minErase, maxErase);
+
+    _check(minErase > 0 && (maxErase - minErase) <= 1, "wear: sectors not erased equally");
+}
+
+/*
+** The age comes from the scheduler clock, which restarts when we reset
+** & stops while we sleep...
+*/
+static void _testAge(void) {
+    flashSimReset();
+    flashLogInit();
+
+    _append(1);
+    _rtcISRTicks((uint32_t)rtc_val_min(10));
+
+    sentCount = 0;
+    _upload(1);
+    _check(sent[0].ageMinutes == 10, "age: wrong age");
+
+    _append(2);
+    flashLogInit();
+    _append(3);
+    _rtcISRTicks((uint32_t)rtc_val_min(5));
+
+    _upload(2);
+    _check(sent[1].ageMinutes == TEST_AGE_UNKNOWN, "age: known across a reset");
+    _check(sent[2].ageMinutes == 5, "age: wrong age after a reset");
+
+    _append(4);
+    flashLogNewEpoch();
+    _append(5);
+    _rtcISRTicks((uint32_t)rtc_val_min(2));
+
+    _upload(2);
+    _check(sent[3].ageMinutes == TEST_AGE_UNKNOWN, "age: known across a sleep");
+    _check(sent[4].ageMinutes == 2, "age: wrong age after a sleep");
+
+    printf("Age:         unknown across a reset or sleep\n");
+}
+
+int main(void) {
+    _testAppendAndReboot();
+    _testTornWrite();
+    _testOutage();
+    _testWrapAndWear();
+    _testAge();
+
+    printf("%s\n", isFail ? "FAILED" : "PASSED");
+
+    return (isFail ? 1 : 0);
+}
@@ -0,0 +1,209 @@
+/******************************************************************************
+**
+** File: test_icp10125.c
+**
+** Description: Host check of the fixed point ICP10125 pressure conversion.
+** Sweeps random OTP calibrations, the whole T_LSB range & raw pressures
+** covering 25 - 115 kPa, comparing icp10125_process_data() with an exact
+** double evaluation of the datasheet formula. The float version from the
+** datasheet (icp10125_process_data_float) is compared too, for reference.
+**
+** Fails if any point is more than ICP_TEST_TOLERANCE_PA out, if fewer than
+** ICP_TEST_MIN_EXACT_PCT are within 1 Pa, or if a valid calibration is
+** rejected.
+**
+******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "icp10125.h"
+
+#define ICP_TEST_OTP_SETS           400
+#define ICP_TEST_T_STEP             97
+#define ICP_TEST_P_STEPS            40
+#define ICP_TEST_P_MIN              25000.0
+#define ICP_TEST_P_MAX              115000.0
+
+#define ICP_TEST_TOLERANCE_PA       2
+#define ICP_TEST_MIN_EXACT_PCT      99.9
+
+static uint16_t             otp[4];
+
+static void _getLUT(int T_LSB, double * s) {
+    double      t = (double)T_LSB - 32768.0;
+    double      q = t * t * 0.000000059605;
+
+    s[0] = 3670016.0 + otp[0] * q;
+    s[1] = 2048.0 * otp[3] + otp[1] * q;
+    s[2] = 12058624.0 + otp[2] * q;
+}
+
+/*
+** The datasheet formula, in double...
+*/
+static double _refPressure(int p_LSB, int T_LSB) {
+    const double    P[3] = {45000.0, 80000.0, 105000.0};
+    double          s[3];
+    double          A;
+    double          B;
+    double          C;
+
+    _getLUT(T_LSB, s);
+
+    C = (s[0] * s[1] * (P[0] - P[1]) + s[1] * s[2] * (P[1] - P[2]) + s[2] * s[0] * (P[2] - P[0])) /
+        (s[2] * (P[0] - P[1]) + s[0] * (P[1] - P[2]) + s[1] * (P[2] - P[0]));
+    A = (P[0] * s[0] - P[1] * s[1] - (P[1] - P[0]) * C) / (s[0] - s[1]);
+    B = (P[0] - A) * (s[0] + C);
+
+    return A + B / (C + p_LSB);
+}
+
+/*
+** The raw reading for a pressure, by bisection...
+*/
+static int _rawForPressure(double Pa, int T_LSB) {
+    double      lo = 0.0;
+    double      hi = (double)((1 << 24) - 1);
+    double      mid;
+    int         i;
+
+    for (i = 0;i < 60;i++) {
+        mid = (lo + hi) / 2.0;
+
+        if (_refPressure((int)mid, T_LSB) > Pa) {
+            hi = mid;
+        }
+        else {
+            lo = mid;
+        }
+    }
+
+    return (int)lo;
+}
+
+int main(void) {
+    long            points = 0;
+    long            exact = 0;
+    long            floatMatch = 0;
+    long            skipped = 0;
+    long            badReject = 0;
+    double          maxError = 0.0;
+    double          maxFloatError = 0.0;
+    double          ref;
+    double          s[3];
+    double          exactPct;
+    int             o;
+    int             T;
+    int             k;
+    int             lo;
+    int             hi;
+    int             p;
+    int             fixed;
+    int             flt;
+    bool            isFail = false;
+
+    srand(1);
+
+    for (o = 0;o < ICP_TEST_OTP_SETS;o++) {
+        if (o == 0) {
+            otp[0] = 0;
+            otp[1] = 0;
+            otp[2] = 0;
+            otp[3] = 1800;
+        }
+        else if (o == 1) {
+            otp[0] = 65535;
+            otp[1] = 65535;
+            otp[2] = 65535;
+            otp[3] = 5800;
+        }
+        else {
+            otp[0] = rand() & 0xFFFF;
+            otp[1] = rand() & 0xFFFF;
+            otp[2] = rand() & 0xFFFF;
+            otp[3] = 1800 + rand() % 4000;
+        }
+
+        icp10125_set_otp(otp);
+
+        for (T = 0;T < 65536;T += ICP_TEST_T_STEP) {
+            _getLUT(T, s);
+
+            /*
+            ** The conversion rejects a calibration that isn't
+            ** monotonic, there's no valid pressure to compare...
+            */
+            if (!(s[0] < s[1] && s[1] < s[2])) {
+                skipped++;
+                continue;
+            }
+
+            lo = _rawForPressure(ICP_TEST_P_MIN, T);
+            hi = _rawForPressure(ICP_TEST_P_MAX, T);
+
+            if (lo > hi) {
+                p = lo;
+                lo = hi;
+                hi = p;
+            }
+
+            for (k = 0;k < ICP_TEST_P_STEPS;k++) {
+                p = lo + (int)((double)(hi - lo) * k / (ICP_TEST_P_STEPS - 1));
+                ref = trunc(_refPressure(p, T));
+
+                if (ref < ICP_TEST_P_MIN || ref > ICP_TEST_P_MAX) {
+                    continue;
+                }
+
+                if (icp10125_process_data(p, T, &fixed) < 0) {
+                    badReject++;
+                    continue;
+                }
+
+                icp10125_process_data_float(p, T, &flt);
+
+                points++;
+
+                if (fabs(fixed - ref) <= 1.0) {
+                    exact++;
+                }
+                if (fabs(fixed - ref) > maxError) {
+                    maxError = fabs(fixed - ref);
+                }
+                if (fabs(flt - ref) > maxFloatError) {
+                    maxFloatError = fabs(flt - ref);
+                }
+                if (fixed == flt) {
+                    floatMatch++;
+                }
+            }
+        }
+    }
+
+    exactPct = (points ? 100.0 * exact / points : 0.0);
+
+    printf("Points:          %ld (%ld non-monotonic T skipped)\n", points, skipped);
+    printf("Fixed vs double: max %.0f Pa, %.4f%% within 1 Pa\n", maxError, exactPct);
+    printf("Float vs double: max %.0f Pa\n", maxFloatError);
+    printf("Fixed == float:  %.2f%%\n", (points ? 100.0 * floatMatch / points : 0.0));
+
+    if (badReject) {
+        printf("FAIL: %ld valid points rejected\n", badReject);
+        isFail = true;
+    }
+    if (maxError > ICP_TEST_TOLERANCE_PA) {
+        printf("FAIL: error over %d Pa\n", ICP_TEST_TOLERANCE_PA);
+        isFail = true;
+    }
+    if (exactPct < ICP_TEST_MIN_EXACT_PCT) {
+        printf("FAIL: under %.1f%% within 1 Pa\n", ICP_TEST_MIN_EXACT_PCT);
+        isFail = true;
+    }
+
+    printf("%s\n", isFail ? "FAILED" : "PASSED");
+
+    return (isFail ? 1 : 0);
+}
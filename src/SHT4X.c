@@ -1,7 +1,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
+#include "pico/stdlib.h"
 #include "hardware/i2c.h"
 #include "scheduler.h"
 #include "taskdef.h"
@@ -9,18 +11,208 @@
 #include "rtc_rp2040.h"
 #include "SHT4X.h"
 
+/*
+** Measurement command for each precision...
+*/
+static const uint8_t    measureCmd[3] = {
+                            SHT4X_CMD_MEASURE_LO_PRN,
+                            SHT4X_CMD_MEASURE_MD_PRN,
+                            SHT4X_CMD_MEASURE_HI_PRN};
+
+/*
+** The I2C rail is powered down between cycles, so the sensor has always
+** just come out of its power-on reset and only needs the soft reset to
+** check it is there the first time...
+*/
+static bool             isDevicePresent = false;
+
+/*
+** Heater schedule, see sht4x_set_heater_schedule()...
+*/
+static uint16_t         heaterInterval = 0;
+static uint16_t         heaterThreshold = 0;
+static uint8_t          heaterCmd = SHT4X_CMD_MEASURE_HI_HT_100MS_HI_PRN;
+static uint16_t         cyclesSinceHeater = 0;
+
+/*
+** CRC-8, polynomial 0x31, initialised to 0xFF...
+*/
+static uint8_t _crc8(const uint8_t * data, int length) {
+    uint8_t         crc = 0xFF;
+    int             i;
+    int             bit;
+
+    for (i = 0;i < length;i++) {
+        crc ^= data[i];
+
+        for (bit = 0;bit < 8;bit++) {
+            if (crc & 0x80) {
+                crc = (uint8_t)((crc << 1) ^ 0x31);
+            }
+            else {
+                crc <<= 1;
+            }
+        }
+    }
+
+    return crc;
+}
+
+/*
+** Read the serial number, the CRCs tell us the data arrived intact...
+*/
+int sht4x_probe(i2c_inst_t * i2c) {
+    int             error;
+    uint8_t         cmd = SHT4X_CMD_READ_SERIAL_NO;
+    uint8_t         buffer[6];
+
+    error = i2cWriteTimeoutProtected(i2c, SHT4X_ADDRESS, &cmd, 1);
+
+    if (error < 0) {
+        return error;
+    }
+
+    sleep_ms(SHT4X_SERIAL_NO_TIME_MS);
+
+    error = i2cReadTimeoutProtected(i2c, SHT4X_ADDRESS, buffer, 6);
+
+    if (error < 0) {
+        return error;
+    }
+
+    if (_crc8(&buffer[0], 2) != buffer[2] || _crc8(&buffer[3], 2) != buffer[5]) {
+        return PICO_ERROR_IO;
+    }
+
+    return 0;
+}
+
 int sht4x_setup(i2c_inst_t * i2c) {
     int         error;
     uint8_t     reg;
 
+    if (isDevicePresent) {
+        return 0;
+    }
+
     reg = SHT4X_CMD_SOFT_RESET;
 
-    error = i2cWriteTimeoutProtected(i2c0, SHT4X_ADDRESS, &reg, 1, false);
+    error = i2cWriteTimeoutProtected(i2c, SHT4X_ADDRESS, &reg, 1);
 
     if (error == PICO_ERROR_TIMEOUT) {
         return PICO_ERROR_TIMEOUT;
     }
-    else {
+    else if (error < 0) {
+        return error;
+    }
+
+    /*
+    ** The sensor ignores commands until the reset is complete, and the
+    ** first measurement can follow straight after setup...
+    */
+    sleep_ms(SHT4X_SOFT_RESET_TIME_MS);
+
+    isDevicePresent = true;
+
+    return 0;
+}
+
+/*
+** Read the result of the last measurement, checking the CRC of both the 
+** temperature & humidity words. Returns PICO_ERROR_IO on a CRC error...
+*/
+int sht4x_read(i2c_inst_t * i2c, uint16_t * rawTemperature, uint16_t * rawHumidity) {
+    int             error;
+    uint8_t         buffer[6];
+
+    error = i2cReadTimeoutProtected(i2c, SHT4X_ADDRESS, buffer, 6);
+
+    if (error < 0) {
+        return error;
+    }
+
+    if (_crc8(&buffer[0], 2) != buffer[2] || _crc8(&buffer[3], 2) != buffer[5]) {
+        return PICO_ERROR_IO;
+    }
+
+    *rawTemperature = (uint16_t)(((uint16_t)buffer[0]) << 8 | (uint16_t)buffer[1]);
+    *rawHumidity = (uint16_t)(((uint16_t)buffer[3]) << 8 | (uint16_t)buffer[4]);
+
+    return 0;
+}
+
+/*
+** Start a measurement at the precision given, read it with sht4x_read()
+** once the conversion time has passed...
+*/
+int sht4x_start_measure(i2c_inst_t * i2c, sht4x_precision_t precision) {
+    uint8_t         cmd;
+
+    if (precision > SHT4X_PRECISION_HIGH) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    cmd = measureCmd[precision];
+
+    return i2cWriteTimeoutProtected(i2c, SHT4X_ADDRESS, &cmd, 1);
+}
+
+/*
+** Run the heater every intervalCycles calls to sht4x_is_heater_due() 
+** while the raw humidity is at or above rawHumidityThreshold, e.g. to 
+** drive off condensation. An interval of 0 disables the heater...
+*/
+void sht4x_set_heater_schedule(uint16_t intervalCycles, uint16_t rawHumidityThreshold, uint8_t cmd) {
+    heaterInterval = intervalCycles;
+    heaterThreshold = rawHumidityThreshold;
+    heaterCmd = cmd;
+    cyclesSinceHeater = 0;
+}
+
+/*
+** Called once per cycle with the latest humidity reading...
+*/
+bool sht4x_is_heater_due(uint16_t rawHumidity) {
+    if (heaterInterval == 0) {
+        return false;
+    }
+
+    if (cyclesSinceHeater < heaterInterval) {
+        cyclesSinceHeater++;
+    }
+
+    if (cyclesSinceHeater >= heaterInterval && rawHumidity >= heaterThreshold) {
+        cyclesSinceHeater = 0;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+** Start a heater pulse, which ends with a high precision measurement. 
+** Returns the time in ms before the result can be read with sht4x_read(), 
+** the reading is taken hot so is only of use as a check...
+*/
+int sht4x_start_heater(i2c_inst_t * i2c) {
+    int             error;
+    uint8_t         cmd;
+
+    cmd = heaterCmd;
+
+    error = i2cWriteTimeoutProtected(i2c, SHT4X_ADDRESS, &cmd, 1);
+
+    if (error < 0) {
         return error;
     }
+
+    switch (cmd) {
+        case SHT4X_CMD_MEASURE_HI_HT_1S_HI_PRN:
+        case SHT4X_CMD_MEASURE_MD_HT_1S_HI_PRN:
+        case SHT4X_CMD_MEASURE_LO_HT_1S_HI_PRN:
+            return SHT4X_HEATER_TIME_1S_MS;
+
+        default:
+            return SHT4X_HEATER_TIME_100MS_MS;
+    }
 }
@@ -1,3 +1,7 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hardware/i2c.h"
 #include "i2c_addr.h"
 
 #ifndef __INCL_SHT4X
@@ -16,6 +20,47 @@
 #define SHT4X_CMD_READ_SERIAL_NO                    0x89
 #define SHT4X_CMD_SOFT_RESET                        0x94
 
+/*
+** Max conversion times from the datasheet...
+*/
+#define SHT4X_MEASURE_TIME_LO_PRN_US                1600
+#define SHT4X_MEASURE_TIME_MD_PRN_US                4500
+#define SHT4X_MEASURE_TIME_HI_PRN_US                8300
+
+#define SHT4X_SERIAL_NO_TIME_MS                     1
+#define SHT4X_SOFT_RESET_TIME_MS                    1
+#define SHT4X_HEATER_TIME_1S_MS                     1100
+#define SHT4X_HEATER_TIME_100MS_MS                  110
+
+/*
+** Raw humidity value for a relative humidity in %, RH = -6 + 125 * raw / 65535...
+*/
+#define SHT4X_RAW_HUMIDITY(rh)                      ((uint16_t)((((rh) + 6) * 65535UL) / 125))
+
+/*
+** Default heater schedule, a 1s pulse at medium power at most once an hour
+** (every 15 cycles of 4 minutes) when the humidity is 95% or above...
+*/
+#define SHT4X_HEATER_INTERVAL_CYCLES                15
+#define SHT4X_HEATER_RH_THRESHOLD                   SHT4X_RAW_HUMIDITY(95)
+#define SHT4X_HEATER_CMD                            SHT4X_CMD_MEASURE_MD_HT_1S_HI_PRN
+
+typedef enum {
+    SHT4X_PRECISION_LOW = 0,
+    SHT4X_PRECISION_MEDIUM = 1,
+    SHT4X_PRECISION_HIGH = 2
+}
+sht4x_precision_t;
+
+int         sht4x_probe(i2c_inst_t * i2c);
 int         sht4x_setup(i2c_inst_t * i2c);
+int         sht4x_start_measure(i2c_inst_t * i2c, sht4x_precision_t precision);
+int         sht4x_read(i2c_inst_t * i2c, uint16_t * rawTemperature, uint16_t * rawHumidity);
+void        sht4x_set_heater_schedule(
+                uint16_t intervalCycles, 
+                uint16_t rawHumidityThreshold, 
+                uint8_t cmd);
+bool        sht4x_is_heater_due(uint16_t rawHumidity);
+int         sht4x_start_heater(i2c_inst_t * i2c);
 
 #endif
@@ -1,41 +1,130 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "hardware/i2c.h"
 #include "i2c_rp2040.h"
 #include "TMP117.h"
 
+/*
+** The I2C rail is powered down between cycles, which resets the config
+** but not the device ID, so the ID is only checked the first time...
+*/
+static bool             isDeviceIDValid = false;
+
+/*
+** Check the device answers with the right ID, e.g. when working out
+** how fast the bus can go...
+*/
+int tmp117_probe(i2c_inst_t * i2c) {
+    int                 error;
+    uint8_t             deviceIDValue[2];
+
+    error = i2cReadRegister(i2c, TMP117_ADDRESS, TMP117_REG_DEVICE_ID, deviceIDValue, 2);
+
+    if (error < 0) {
+        return error;
+    }
+
+    if ((((uint16_t)deviceIDValue[0]) << 8 | (uint16_t)deviceIDValue[1]) != 0x0117) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return 0;
+}
+
 int tmp117_setup(i2c_inst_t * i2c) {
     int                 error = 0;
     uint8_t             deviceIDValue[2];
     uint16_t            deviceID;
     uint8_t             configData[2];
 
-    error = i2cReadRegister(i2c, TMP117_ADDRESS, TMP117_REG_DEVICE_ID, deviceIDValue, 2);
+    if (!isDeviceIDValid) {
+        error = i2cReadRegister(i2c, TMP117_ADDRESS, TMP117_REG_DEVICE_ID, deviceIDValue, 2);
 
-    if (error == PICO_ERROR_TIMEOUT) {
-        return PICO_ERROR_TIMEOUT;
-    }
-    else {
-        deviceID = ((uint16_t)deviceIDValue[0]) << 8 | (uint16_t)deviceIDValue[1];
+        if (error == PICO_ERROR_TIMEOUT) {
+            return PICO_ERROR_TIMEOUT;
+        }
+        else {
+            deviceID = ((uint16_t)deviceIDValue[0]) << 8 | (uint16_t)deviceIDValue[1];
 
-        if (deviceID != 0x0117) {
-            return PICO_ERROR_GENERIC;
+            if (deviceID != 0x0117) {
+                return PICO_ERROR_GENERIC;
+            }
         }
+
+        isDeviceIDValid = true;
     }
 
     /*
-    ** Continuous conversion, 8 sample average, 4 sec cycle time...
+    ** The power-on default is continuous conversion, shut the sensor down
+    ** until the sensor task triggers a one-shot conversion...
     */
-    configData[0] = 0x02;
-    configData[1] = 0xA0;
-    error = i2cWriteRegister(i2c0, TMP117_ADDRESS, TMP117_REG_CONFIG, configData, 2);
+    configData[0] = (uint8_t)((TMP117_CONFIG_MODE_SHUTDOWN >> 8) & 0xFF);
+    configData[1] = (uint8_t)(TMP117_CONFIG_MODE_SHUTDOWN & 0xFF);
+
+    error = i2cWriteRegister(i2c, TMP117_ADDRESS, TMP117_REG_CONFIG, configData, 2);
+
+    if (error < 0) {
+        return error;
+    }
+
+    return 0;
+}
+
+/*
+** Trigger a single conversion, 8 sample average, which takes 
+** TMP117_ONE_SHOT_TIME_MS. The sensor shuts down again once done...
+*/
+int tmp117_start_one_shot(i2c_inst_t * i2c) {
+    int                 error;
+    uint8_t             configData[2];
+    uint16_t            config;
+
+    config = TMP117_CONFIG_MODE_ONE_SHOT | TMP117_CONFIG_AVG_8;
+
+    configData[0] = (uint8_t)((config >> 8) & 0xFF);
+    configData[1] = (uint8_t)(config & 0xFF);
 
-    if (error == PICO_ERROR_TIMEOUT) {
-        return PICO_ERROR_TIMEOUT;
+    error = i2cWriteRegister(i2c, TMP117_ADDRESS, TMP117_REG_CONFIG, configData, 2);
+
+    if (error < 0) {
+        return error;
     }
-    else {
-        return error; 
+
+    return 0;
+}
+
+/*
+** Read the result of the one-shot conversion. Reading the config register 
+** clears the data ready flag, returns PICO_ERROR_NO_DATA if the 
+** conversion hasn't finished yet...
+*/
+int tmp117_read_temperature(i2c_inst_t * i2c, int16_t * rawTemperature) {
+    int                 error;
+    uint8_t             buffer[2];
+    uint16_t            config;
+
+    error = i2cReadRegister(i2c, TMP117_ADDRESS, TMP117_REG_CONFIG, buffer, 2);
+
+    if (error < 0) {
+        return error;
     }
+
+    config = ((uint16_t)buffer[0]) << 8 | (uint16_t)buffer[1];
+
+    if ((config & TMP117_CONFIG_DATA_READY) == 0) {
+        return PICO_ERROR_NO_DATA;
+    }
+
+    error = i2cReadRegister(i2c, TMP117_ADDRESS, TMP117_REG_TEMP, buffer, 2);
+
+    if (error < 0) {
+        return error;
+    }
+
+    *rawTemperature = (int16_t)(((uint16_t)buffer[0]) << 8 | (uint16_t)buffer[1]);
+
+    return 0;
 }
@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include "scheduler.h"
 #include "hardware/i2c.h"
 #include "i2c_addr.h"
@@ -10,6 +12,24 @@
 #define TMP117_REG_TEMP_OFFSET          0x07
 #define TMP117_REG_DEVICE_ID            0x0F
 
+#define TMP117_CONFIG_DATA_READY        0x2000
+#define TMP117_CONFIG_MODE_SHUTDOWN     0x0400
+#define TMP117_CONFIG_MODE_ONE_SHOT     0x0C00
+#define TMP117_CONFIG_AVG_8             0x0020
+
+/*
+** Conversion time for 8 averaged samples...
+*/
+#define TMP117_ONE_SHOT_TIME_MS         125
+
+/*
+** How many extra ticks we wait for the data ready flag...
+*/
+#define TMP117_READY_RETRIES            2
+
+int         tmp117_probe(i2c_inst_t * i2c);
 int         tmp117_setup(i2c_inst_t * i2c);
+int         tmp117_start_one_shot(i2c_inst_t * i2c);
+int         tmp117_read_temperature(i2c_inst_t * i2c, int16_t * rawTemperature);
 
 #endif
@@ -27,8 +27,15 @@
 #include "sensor.h"
 #include "watchdog.h"
 #include "nRF24L01.h"
+#include "radio.h"
 #include "battery.h"
 #include "gpio_cntrl.h"
+#include "serial_rp2040.h"
+#include "utils.h"
+#include "clock_rp2040.h"
+#include "max17048.h"
+#include "budget.h"
+#include "flashlog.h"
 
 #define STATE_START                         0x0001
 #define STATE_RADIO_POWER_UP                0x0100
@@ -38,28 +45,95 @@
 
 #define SLEEP_PERIOD_OFF                    0
 #define SLEEP_PERIOD_1H                     1
-#define SLEEP_PERIOD_15H                   15
-#define SLEEP_PERIOD_24H                   24
 #define SLEEP_PERIOD_72H                   72
 
 //#define DEBUG_SLEEP
 
 static datetime_t           dt;
 static datetime_t           alarm_dt;
+static volatile bool        isAwake = false;
 
 void wakeUp(void) {
-	/*
-	** Enable the watchdog, it will reset the device in 100ms...
-	*/
-	watchdog_enable(100, false);
+    isAwake = true;
 }
 
+/*
+** Bring everything we shut down before sleeping back up and carry on
+** where we left off. RAM is retained while we sleep, so the packet 
+** number, rain totals and the rest of our state are preserved...
+*/
+static void resumeFromSleep(void) {
+    rtc_disable_alarm();
+
+    /*
+    ** Restart the scheduler tick and the pulse counters...
+    */
+    setupRTC();
+    enablePIO();
+
+    if (isDebugActive()) {
+        initSerial(uart0);
+    }
+
+    /*
+    ** The sensor task may have been part way through a cycle, the I2C 
+    ** & SPI buses have been shut down, so start it from the top...
+    */
+    sensorResetCycle();
+
+    /*
+    ** The scheduler clock stopped while we slept, the budget can't
+    ** measure the drain across the gap & the logged readings from 
+    ** before it can't be given an age...
+    */
+    budgetReset();
+    flashLogNewEpoch();
+
+    resumeAllTasks();
+
+    watchdogResetCheckIns();
+	watchdog_enable(3000, false);
+}
+
+/*
+** The gauge ALRT pin is pulled low when the SOC drops below the alert
+** threshold, which signals the battery monitor rather than it having to
+** poll the battery...
+*/
+void batteryInit(void) {
+    gpio_init(MAX17048_ALERT_PIN);
+    gpio_set_dir(MAX17048_ALERT_PIN, GPIO_IN);
+    gpio_pull_up(MAX17048_ALERT_PIN);
+
+    gpioSignalTaskOnEdge(MAX17048_ALERT_PIN, GPIO_IRQ_EDGE_FALL, TASK_BATTERY_MONITOR);
+}
+
+/*
+** The SOC threshold to alert us at. Above the critical level the energy
+** budget stretches the report interval to get us through the night, so
+** we only need to know if it fails to...
+*/
+uint8_t batteryGetAlertThreshold(uint8_t batteryPercentage) {
+    return BATTERY_PERCENTAGE_CRITICAL;
+}
+
+static int getSleepPeriod(uint8_t batteryPercentage) {
+    if (batteryPercentage < BATTERY_PERCENTAGE_CRITICAL) {
+        return SLEEP_PERIOD_72H;
+    }
+
+    return SLEEP_PERIOD_OFF;
+}
+
+/*
+** Runs when signalled by the gauge alert, or once after startup & 
+** waking to check the latest reading from the sensor task...
+*/
 void taskBatteryMonitor(PTASKPARM p) {
     static int                  state = STATE_START;
-    static int                  runCount = 0;
     static int                  sleepPeriod = SLEEP_PERIOD_OFF;
-    static uint8_t              lastBatteryPct = 90;
     uint8_t                     buffer[32];
+    uint8_t                     batteryPct;
     rtc_t                       delay = rtc_val_sec(10);
     sleep_packet_t *            pSleep;
     weather_packet_t *          pWeather;
@@ -67,36 +141,24 @@ void taskBatteryMonitor(PTASKPARM p) {
     pWeather = getWeatherPacket();
     pSleep = getSleepPacket();
 
+    if (state == STATE_START) {
 #ifndef DEBUG_SLEEP
-    /* 
-    ** If the battery percentage has dropped below critical,
-    ** stop everything and put the RP2040 to sleep...
-    */
-    if (runCount > 6) {
-        if (pWeather->rawBatteryPercentage < BATTERY_PERCENTAGE_CRITICAL && lastBatteryPct < BATTERY_PERCENTAGE_CRITICAL) {
-            sleepPeriod = SLEEP_PERIOD_72H;
-        }
-        else if (pWeather->rawBatteryPercentage < BATTERY_PERCENTAGE_VLOW && lastBatteryPct < BATTERY_PERCENTAGE_VLOW) {
-            /*
-            ** Sleep for 24 hours to preserve the battery overnight
-            */
-            sleepPeriod = SLEEP_PERIOD_24H;
-        }
-        else if (pWeather->rawBatteryPercentage < BATTERY_PERCENTAGE_LOW && lastBatteryPct < BATTERY_PERCENTAGE_LOW) {
-            /*
-            ** Sleep for 15 hours to preserve the battery overnight
-            */
-            sleepPeriod = SLEEP_PERIOD_15H;
-        }
-        else {
-            sleepPeriod = SLEEP_PERIOD_OFF;
+        batteryPct = pWeather->rawBatteryPercentage;
+
+        /*
+        ** The sensor task clears the alert when it next reads the gauge,
+        ** until then the SOC is below the threshold, whatever the last 
+        ** reading said...
+        */
+        if (!gpio_get(MAX17048_ALERT_PIN) && batteryPct >= max17048_get_alert_threshold()) {
+            batteryPct = max17048_get_alert_threshold() - 1;
         }
-    }
+
+        sleepPeriod = getSleepPeriod(batteryPct);
 #else
-    sleepPeriod = SLEEP_PERIOD_1H;
+        sleepPeriod = SLEEP_PERIOD_1H;
 #endif
-
-    lastBatteryPct = pWeather->rawBatteryPercentage;
+    }
 
     if (sleepPeriod) {
         /*
@@ -112,10 +174,24 @@ void taskBatteryMonitor(PTASKPARM p) {
         */
         switch (state) {
             case STATE_START:
+                /*
+                ** Don't fight the radio task for the SPI bus...
+                */
+                if (radioIsBusy()) {
+                    delay = rtc_val_ms(100);
+                    break;
+                }
+
                 watchdog_disable();
 
+                /*
+                ** Stop everything else, the tasks keep their state
+                ** and pick up where they left off when we wake...
+                */
+                suspendAllTasksExcept(TASK_BATTERY_MONITOR);
+
                 initGPIOs();
-                spi_init(spi0, 5000000);
+                clockSPIInit(spi0, 5000000);
 
                 state = STATE_RADIO_POWER_UP;
                 delay = rtc_val_sec(1);
@@ -157,9 +233,12 @@ void taskBatteryMonitor(PTASKPARM p) {
             case STATE_SLEEP:
                 disableRTC();
 
-                i2c_deinit(i2c0);
-                spi_deinit(spi0);
-                uart_deinit(uart0);
+                clockI2CDeinit(i2c0);
+#ifdef I2C_DUAL_BUS
+                clockI2CDeinit(i2c1);
+#endif
+                clockSPIDeinit(spi0);
+                clockUARTDeinit(uart0);
                 deInitGPIOs();
 
                 disablePIO();
@@ -190,14 +269,6 @@ void taskBatteryMonitor(PTASKPARM p) {
                     alarm_dt.day = 4;
                     alarm_dt.hour = -1;
                 }
-                else if (sleepPeriod == SLEEP_PERIOD_24H) {
-                    alarm_dt.day = 2;
-                    alarm_dt.hour = -1;
-                }
-                else if (sleepPeriod == SLEEP_PERIOD_15H) {
-                    alarm_dt.day = -1;
-                    alarm_dt.hour = 15;
-                }
                 else if (sleepPeriod == SLEEP_PERIOD_1H) {
                     alarm_dt.day = -1;
                     alarm_dt.hour = -1;
@@ -217,15 +288,33 @@ void taskBatteryMonitor(PTASKPARM p) {
                 scb_hw->scr = save | M0PLUS_SCR_SLEEPDEEP_BITS;
 
                 /*
-                ** Now we can go to sleep zzzzzzzz
+                ** Now we can go to sleep zzzzzzzz, another interrupt 
+                ** (e.g. the debug pin) may wake us before the alarm...
                 */
-                __wfi();
-                break;
+                isAwake = false;
+
+                while (!isAwake) {
+                    __wfi();
+                }
+
+                scb_hw->scr = save;
+
+                clocks_hw->sleep_en0 = 0xFFFFFFFF;
+                clocks_hw->sleep_en1 = 0xFFFFFFFF;
+
+                resumeFromSleep();
+
+                /*
+                ** Check again once the sensor task has a fresh battery 
+                ** reading, we'll go back to sleep if it's still low...
+                */
+                state = STATE_START;
+                sleepPeriod = SLEEP_PERIOD_OFF;
+
+                scheduleTask(TASK_BATTERY_MONITOR, rtc_val_min(1), false, NULL);
+                return;
         }
 
-        scheduleTaskExlusive(TASK_BATTERY_MONITOR, delay, false, NULL);
-        return;
+        scheduleTask(TASK_BATTERY_MONITOR, delay, false, NULL);
     }
-
-    runCount++;
 }
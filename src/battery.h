@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include "scheduler.h"
 
 #ifndef __INCL_BATTERY
@@ -12,6 +14,8 @@
 #define BATTERY_TEMPERATURE_CRITICAL       5120         // 40 degrees C
 #define BATTERY_TEMPERATURE_LIMIT          4800         // 37.5 degress C
 
-void taskBatteryMonitor(PTASKPARM p);
+void        batteryInit(void);
+uint8_t     batteryGetAlertThreshold(uint8_t batteryPercentage);
+void        taskBatteryMonitor(PTASKPARM p);
 
 #endif
@@ -0,0 +1,248 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "rtc_rp2040.h"
+#include "budget.h"
+
+#ifndef UNIT_TEST_MODE
+#include "logger.h"
+#else
+#define lgLogDebug(...)
+#endif
+
+/*
+** SOC is handled in the gauge's units of 1/256 %, rates in 1/256 %/hr...
+*/
+#define SOC_ONE_PERCENT                     256
+
+#define HISTORY_EMPTY                       0xFFFF
+
+/*
+** Report intervals we choose from, in minutes. The first is the 
+** standard interval we use whenever the budget allows...
+*/
+static const uint16_t       intervalLadder[] = {4, 6, 10, 15, 20, 30, 45, 60, 90, 120};
+
+#define LADDER_SIZE                         (sizeof(intervalLadder) / sizeof(intervalLadder[0]))
+
+/*
+** SOC at the start of each of the last 24 hours, to work out the net 
+** charge over a whole day (solar in less load out)...
+*/
+static uint16_t             socHistory[BUDGET_HISTORY_HOURS];
+static rtc_t                historyHour = 0;
+static bool                 isHistoryInit = false;
+
+static uint16_t             lastSOC = 0;
+static rtc_t                lastTime = 0;
+static bool                 isLastValid = false;
+
+/*
+** Smoothed cost of one report, learnt from the drain while discharging...
+*/
+static int32_t              reportCost = BUDGET_DEFAULT_REPORT_COST * 8;
+
+/*
+** When the battery started discharging, and the longest run of
+** discharging seen, e.g. how long the night is...
+*/
+static rtc_t                dischargeStart = 0;
+static bool                 isDischarging = false;
+static uint32_t             nightMinutes = BUDGET_DEFAULT_NIGHT_HOURS * 60;
+
+static int                  intervalIndex = 0;
+static budget_level_t       sensorLevel = BUDGET_LEVEL_FULL;
+
+static void _updateHistory(uint16_t soc, rtc_t now) {
+    rtc_t               hour;
+
+    hour = now / RTC_ONE_HOUR;
+
+    if (!isHistoryInit || (hour - historyHour) >= BUDGET_HISTORY_HOURS) {
+        memset(socHistory, 0xFF, sizeof(socHistory));
+        isHistoryInit = true;
+    }
+    else if (hour == historyHour) {
+        return;
+    }
+    else {
+        /*
+        ** Any hours we've missed are left empty...
+        */
+        while (++historyHour < hour) {
+            socHistory[historyHour % BUDGET_HISTORY_HOURS] = HISTORY_EMPTY;
+        }
+    }
+
+    historyHour = hour;
+    socHistory[hour % BUDGET_HISTORY_HOURS] = soc;
+}
+
+/*
+** Drain (1/256 %/hr) predicted when reporting every intervalMins...
+*/
+static int32_t _predictDrain(uint16_t intervalMins) {
+    return BUDGET_BASE_DRAIN + ((reportCost * 60) / 8) / (int32_t)intervalMins;
+}
+
+/*
+** Net change in SOC over the last day, (1/256 %), or 0 if we haven't
+** been running for a day yet...
+*/
+int32_t budgetGetNetPerDay(void) {
+    uint16_t            socDayAgo;
+
+    if (!isHistoryInit) {
+        return 0;
+    }
+
+    socDayAgo = socHistory[(historyHour + 1) % BUDGET_HISTORY_HOURS];
+
+    if (socDayAgo == HISTORY_EMPTY) {
+        return 0;
+    }
+
+    return (int32_t)socHistory[historyHour % BUDGET_HISTORY_HOURS] - (int32_t)socDayAgo;
+}
+
+/*
+** Called with each gauge reading. Works out how fast we can afford to
+** drain the battery and still have BUDGET_TARGET_MIN_SOC left by dawn,
+** then picks the shortest report interval that fits...
+*/
+void budgetUpdate(uint16_t rawSOC, int16_t rawChargeRate) {
+    rtc_t               now;
+    rtc_t               elapsed;
+    int32_t             drain;
+    int32_t             cost;
+    int32_t             target;
+    int32_t             netPerDay;
+    int32_t             allowed;
+    uint32_t            minutesLeft;
+    uint32_t            runMinutes;
+    int                 i;
+
+    now = getRTCClock();
+
+    _updateHistory(rawSOC, now);
+
+    /*
+    ** Learn the cost of a report from the measured drain, the SOC 
+    ** has a resolution of 1/256 % so smooth it heavily...
+    */
+    if (isLastValid && (now - lastTime) >= rtc_val_min(2)) {
+        elapsed = now - lastTime;
+        drain = (int32_t)(((int64_t)lastSOC - (int64_t)rawSOC) * (int64_t)RTC_ONE_HOUR / (int64_t)elapsed);
+
+        if (drain > 0 && rawChargeRate <= 0) {
+            cost = ((drain - BUDGET_BASE_DRAIN) * (int32_t)intervalLadder[intervalIndex] * 8) / 60;
+
+            if (cost < 0) {
+                cost = 0;
+            }
+
+            reportCost += (cost - reportCost) / 8;
+        }
+    }
+
+    lastSOC = rawSOC;
+    lastTime = now;
+    isLastValid = true;
+
+    /*
+    ** Track the discharge runs to learn how long the nights are...
+    */
+    if (rawChargeRate < 0) {
+        if (!isDischarging) {
+            dischargeStart = now;
+            isDischarging = true;
+        }
+    }
+    else if (rawChargeRate > 0 && isDischarging) {
+        runMinutes = (now - dischargeStart) / RTC_ONE_MINUTE;
+
+        /*
+        ** Ignore short runs, e.g. a cloud passing over...
+        */
+        if (runMinutes >= (4 * 60) && runMinutes <= (24 * 60)) {
+            nightMinutes = (nightMinutes * 3 + runMinutes) / 4;
+        }
+
+        isDischarging = false;
+    }
+
+    if (isDischarging) {
+        runMinutes = (now - dischargeStart) / RTC_ONE_MINUTE;
+        minutesLeft = (runMinutes + 60 < nightMinutes) ? (nightMinutes - runMinutes) : 60;
+    }
+    else {
+        /*
+        ** Charging, plan for a whole night from here...
+        */
+        minutesLeft = nightMinutes;
+    }
+
+    /*
+    ** If we've lost charge over the last day, keep enough in hand to
+    ** cover the same again tomorrow...
+    */
+    target = BUDGET_TARGET_MIN_SOC * SOC_ONE_PERCENT;
+    netPerDay = budgetGetNetPerDay();
+
+    if (netPerDay < 0) {
+        target -= netPerDay;
+    }
+
+    allowed = (((int32_t)rawSOC - target) * 60) / (int32_t)minutesLeft;
+
+    intervalIndex = LADDER_SIZE - 1;
+
+    for (i = 0;i < (int)LADDER_SIZE;i++) {
+        if (_predictDrain(intervalLadder[i]) <= allowed) {
+            intervalIndex = i;
+            break;
+        }
+    }
+
+    if (intervalLadder[intervalIndex] <= 10) {
+        sensorLevel = BUDGET_LEVEL_FULL;
+    }
+    else if (intervalLadder[intervalIndex] <= 30) {
+        sensorLevel = BUDGET_LEVEL_REDUCED;
+    }
+    else {
+        sensorLevel = BUDGET_LEVEL_MINIMAL;
+    }
+
+    lgLogDebug(
+        "Budget: SOC %d/256 allowed %d/256/hr for %d min, interval %d min", 
+        (int)rawSOC, 
+        (int)allowed, 
+        (int)minutesLeft, 
+        (int)intervalLadder[intervalIndex]);
+}
+
+/*
+** Called on waking from sleep. The scheduler clock stops while we sleep,
+** so the SOC lost since the last reading can't be turned into a drain
+** rate & the discharge run we were timing has no end we can measure.
+** The SOC history is kept, it's indexed by the (stopped) clock so the
+** hours either side of the sleep are still a day apart...
+*/
+void budgetReset(void) {
+    isLastValid = false;
+    isDischarging = false;
+}
+
+/*
+** The time between reports, in ms...
+*/
+uint32_t budgetGetReportInterval(void) {
+    return (uint32_t)intervalLadder[intervalIndex] * 60U * 1000U;
+}
+
+budget_level_t budgetGetSensorLevel(void) {
+    return sensorLevel;
+}
@@ -0,0 +1,41 @@
+#include <stdint.h>
+
+#include "scheduler.h"
+
+#ifndef __INCL_BUDGET
+#define __INCL_BUDGET
+
+/*
+** The SOC (%) we aim to still have when the sun comes up...
+*/
+#define BUDGET_TARGET_MIN_SOC               20
+
+/*
+** How long we assume the battery discharges for each day until we've
+** seen a night...
+*/
+#define BUDGET_DEFAULT_NIGHT_HOURS          16
+
+/*
+** Drain (SOC in 1/256 %/hr) with no reporting at all, e.g. the sleep 
+** current, and the initial guess at the cost of one report (1/256 %)...
+*/
+#define BUDGET_BASE_DRAIN                   8
+#define BUDGET_DEFAULT_REPORT_COST          1
+
+#define BUDGET_HISTORY_HOURS                24
+
+typedef enum {
+    BUDGET_LEVEL_MINIMAL = 0,
+    BUDGET_LEVEL_REDUCED = 1,
+    BUDGET_LEVEL_FULL = 2
+}
+budget_level_t;
+
+void            budgetUpdate(uint16_t rawSOC, int16_t rawChargeRate);
+void            budgetReset(void);
+uint32_t        budgetGetReportInterval(void);
+budget_level_t  budgetGetSensorLevel(void);
+int32_t         budgetGetNetPerDay(void);
+
+#endif
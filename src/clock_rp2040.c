@@ -0,0 +1,193 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/i2c.h"
+#include "hardware/spi.h"
+#include "hardware/uart.h"
+#include "clock_rp2040.h"
+
+/*
+** The clock policy belongs to core 0, requests must only be made from
+** tasks running on core 0 so the clock never changes underneath a
+** transfer in progress on the other core...
+*/
+static int              requestCount[CLOCK_NUM_PERF_LEVELS];
+static int              currentLevel = -1;
+
+/*
+** The baud rate of each peripheral we've initialised, 0 if it isn't
+** in use, indexed by the SDK instance number...
+*/
+static uint             i2cBaud[2];
+static uint             spiBaud[2];
+static uint             uartBaud[2];
+
+static const uint32_t   levelKHz[CLOCK_NUM_PERF_LEVELS] = {
+    CLOCK_PERF_LOW_KHZ,
+    CLOCK_PERF_STD_KHZ,
+    CLOCK_PERF_HIGH_KHZ
+};
+
+/*
+** I2C is clocked from clk_sys, SPI & UART from clk_peri, which we
+** always run from clk_sys, so all of them need their dividers set
+** again after a change...
+*/
+static void _reapplyBaudRates(void) {
+    int             i;
+
+    for (i = 0;i < 2;i++) {
+        if (i2cBaud[i]) {
+            i2c_set_baudrate(i2c_get_instance(i), i2cBaud[i]);
+        }
+        if (spiBaud[i]) {
+            spi_set_baudrate(spi_get_instance(i), spiBaud[i]);
+        }
+        if (uartBaud[i]) {
+            uart_set_baudrate(uart_get_instance(i), uartBaud[i]);
+        }
+    }
+}
+
+static void _setLevel(int level) {
+    if (level == currentLevel) {
+        return;
+    }
+
+    if (level == CLOCK_PERF_LOW) {
+        /*
+        ** Run clk_sys straight from the crystal and turn the PLL off...
+        */
+        clock_configure(
+                clk_sys, 
+                CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, 
+                CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, 
+                XOSC_KHZ * KHZ, 
+                XOSC_KHZ * KHZ);
+
+        clock_configure(
+                clk_peri, 
+                0, 
+                CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS, 
+                XOSC_KHZ * KHZ, 
+                XOSC_KHZ * KHZ);
+
+        pll_deinit(pll_sys);
+    }
+    else {
+        /*
+        ** This restarts the PLL if it's off and moves clk_peri with 
+        ** clk_sys...
+        */
+        set_sys_clock_khz(levelKHz[level], true);
+    }
+
+    currentLevel = level;
+
+    _reapplyBaudRates();
+}
+
+static void _updateLevel(void) {
+    int             level;
+
+    for (level = CLOCK_PERF_HIGH;level > CLOCK_PERF_LOW;level--) {
+        if (requestCount[level] > 0) {
+            break;
+        }
+    }
+
+    _setLevel(level);
+}
+
+void clockInit(void) {
+    int             i;
+
+    for (i = 0;i < CLOCK_NUM_PERF_LEVELS;i++) {
+        requestCount[i] = 0;
+    }
+
+    _setLevel(CLOCK_PERF_LOW);
+}
+
+/*
+** Request the clock runs at (at least) the performance level until
+** the matching clockRelease()...
+*/
+void clockRequest(int level) {
+    if (level <= CLOCK_PERF_LOW || level >= CLOCK_NUM_PERF_LEVELS) {
+        return;
+    }
+
+    requestCount[level]++;
+
+    _updateLevel();
+}
+
+void clockRelease(int level) {
+    if (level <= CLOCK_PERF_LOW || level >= CLOCK_NUM_PERF_LEVELS) {
+        return;
+    }
+
+    if (requestCount[level] > 0) {
+        requestCount[level]--;
+    }
+
+    _updateLevel();
+}
+
+int clockGetLevel(void) {
+    return currentLevel;
+}
+
+uint32_t clockGetSysKHz(void) {
+    return levelKHz[currentLevel];
+}
+
+uint clockI2CInit(i2c_inst_t * i2c, uint baudrate) {
+    i2cBaud[i2c_get_index(i2c)] = baudrate;
+
+    return i2c_init(i2c, baudrate);
+}
+
+/*
+** Change the speed of a bus that's already initialised, returns the
+** actual baud rate set...
+*/
+uint clockI2CSetBaudrate(i2c_inst_t * i2c, uint baudrate) {
+    i2cBaud[i2c_get_index(i2c)] = baudrate;
+
+    return i2c_set_baudrate(i2c, baudrate);
+}
+
+void clockI2CDeinit(i2c_inst_t * i2c) {
+    i2cBaud[i2c_get_index(i2c)] = 0;
+
+    i2c_deinit(i2c);
+}
+
+uint clockSPIInit(spi_inst_t * spi, uint baudrate) {
+    spiBaud[spi_get_index(spi)] = baudrate;
+
+    return spi_init(spi, baudrate);
+}
+
+void clockSPIDeinit(spi_inst_t * spi) {
+    spiBaud[spi_get_index(spi)] = 0;
+
+    spi_deinit(spi);
+}
+
+uint clockUARTInit(uart_inst_t * uart, uint baudrate) {
+    uartBaud[uart_get_index(uart)] = baudrate;
+
+    return uart_init(uart, baudrate);
+}
+
+void clockUARTDeinit(uart_inst_t * uart) {
+    uartBaud[uart_get_index(uart)] = 0;
+
+    uart_deinit(uart);
+}
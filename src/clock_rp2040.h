@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hardware/i2c.h"
+#include "hardware/spi.h"
+#include "hardware/uart.h"
+
+#ifndef __INCL_CLOCK_RP2040
+#define __INCL_CLOCK_RP2040
+
+/*
+** Performance levels, tasks request the level they need for as long as
+** they need it and the system clock runs at the highest level requested.
+** With no requests we run at CLOCK_PERF_LOW...
+**
+** LOW  - 12 MHz straight from the XOSC, with the system PLL off
+** STD  - 24 MHz from the system PLL
+** HIGH - 48 MHz from the system PLL
+*/
+#define CLOCK_PERF_LOW                      0
+#define CLOCK_PERF_STD                      1
+#define CLOCK_PERF_HIGH                     2
+#define CLOCK_NUM_PERF_LEVELS               3
+
+#define CLOCK_PERF_LOW_KHZ              12000
+#define CLOCK_PERF_STD_KHZ              24000
+#define CLOCK_PERF_HIGH_KHZ             48000
+
+void        clockInit(void);
+void        clockRequest(int level);
+void        clockRelease(int level);
+int         clockGetLevel(void);
+uint32_t    clockGetSysKHz(void);
+
+/*
+** Use these in place of the SDK init/deinit functions, so the baud rates
+** are re-applied whenever the clock changes...
+*/
+uint        clockI2CInit(i2c_inst_t * i2c, uint baudrate);
+uint        clockI2CSetBaudrate(i2c_inst_t * i2c, uint baudrate);
+void        clockI2CDeinit(i2c_inst_t * i2c);
+uint        clockSPIInit(spi_inst_t * spi, uint baudrate);
+void        clockSPIDeinit(spi_inst_t * spi);
+uint        clockUARTInit(uart_inst_t * uart, uint baudrate);
+void        clockUARTDeinit(uart_inst_t * uart);
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "scheduler.h"
+#include "packet.h"
+#include "persist.h"
+#include "crash.h"
+
+static crash_record_t       __uninitialized_ram(crashRecord);
+
+/*
+** What we found in the crash record at boot...
+*/
+static crash_record_t       lastCrash;
+static bool                 isReportPending = false;
+
+/*
+** Called by the scheduler before & after each task runs...
+*/
+static void _traceTask(uint16_t taskID, uint8_t core, uint32_t runTime) {
+    watchdog_trace_t *  t;
+
+    if (runTime == TRACE_TASK_START) {
+        crashRecord.running[core].taskID = taskID;
+        crashRecord.running[core].startTime = time_us_32();
+        return;
+    }
+
+    crashRecord.running[core].taskID = CRASH_NO_TASK;
+
+    crashRecord.traceIndex[core] = (crashRecord.traceIndex[core] + 1) % CRASH_TRACE_LENGTH;
+
+    t = &crashRecord.trace[core][crashRecord.traceIndex[core]];
+
+    t->taskID = taskID;
+    t->runTime = (runTime > UINT16_MAX ? UINT16_MAX : (uint16_t)runTime);
+}
+
+static void _resetRecord(void) {
+    memset(&crashRecord, 0, sizeof(crash_record_t));
+
+    crashRecord.reason = CRASH_REASON_NONE;
+    crashRecord.running[0].taskID = CRASH_NO_TASK;
+    crashRecord.running[1].taskID = CRASH_NO_TASK;
+
+    crashRecord.magic = CRASH_MAGIC;
+}
+
+/*
+** Keep what the last crash left behind for the watchdog packet, then
+** start tracing afresh. Must be called after persistInit()...
+*/
+void crashInit(void) {
+    memcpy(&lastCrash, &crashRecord, sizeof(crash_record_t));
+
+    /*
+    ** After a power on the RAM is random, don't trust it...
+    */
+    if (persistGetResetReason() != PERSIST_RESET_WATCHDOG || lastCrash.magic != CRASH_MAGIC) {
+        memset(&lastCrash, 0, sizeof(crash_record_t));
+
+        lastCrash.reason = CRASH_REASON_NONE;
+        lastCrash.running[0].taskID = CRASH_NO_TASK;
+        lastCrash.running[1].taskID = CRASH_NO_TASK;
+    }
+
+    isReportPending = true;
+
+    _resetRecord();
+
+    registerTraceTask(&_traceTask);
+}
+
+/*
+** Called from handleError() just before we reboot...
+*/
+void crashRecordError(unsigned int code) {
+    crashRecord.reason = CRASH_REASON_SCHED_ERROR;
+    crashRecord.errorCode = (uint16_t)code;
+    crashRecord.errorTime = time_us_32();
+}
+
+/*
+** Called by the watchdog task when a task has stopped checking in, the
+** hardware watchdog will reset us shortly...
+*/
+void crashRecordStalledTask(uint16_t taskID) {
+    crashRecord.reason = CRASH_REASON_TASK_STALLED;
+    crashRecord.errorCode = taskID;
+    crashRecord.errorTime = time_us_32();
+}
+
+/*
+** Fill in the watchdog packet once after boot, returns false if it
+** has already been sent...
+*/
+bool crashGetReport(watchdog_packet_t * pWatchdog) {
+    crash_task_t *      running;
+    uint8_t             core;
+    int                 i;
+    int                 ix;
+
+    if (!isReportPending) {
+        return false;
+    }
+
+    pWatchdog->resetReason = 
+        (lastCrash.reason != CRASH_REASON_NONE) ? lastCrash.reason : persistGetResetReason();
+    pWatchdog->errorCode = lastCrash.errorCode;
+    pWatchdog->bootCount = persistGetBootCount();
+
+    /*
+    ** Report the task that was running, core 0 first...
+    */
+    core = (lastCrash.running[0].taskID == CRASH_NO_TASK && lastCrash.running[1].taskID != CRASH_NO_TASK) ? 1 : 0;
+    running = &lastCrash.running[core];
+
+    pWatchdog->lastTaskID = running->taskID;
+    pWatchdog->lastTaskCore = core;
+
+    if (running->taskID != CRASH_NO_TASK && lastCrash.reason == CRASH_REASON_SCHED_ERROR) {
+        pWatchdog->lastTaskRunTime = lastCrash.errorTime - running->startTime;
+    }
+    else {
+        pWatchdog->lastTaskRunTime = CRASH_TIME_UNKNOWN;
+    }
+
+    pWatchdog->traceCount = 0;
+    ix = lastCrash.traceIndex[core];
+
+    for (i = 0;i < CRASH_TRACE_LENGTH;i++) {
+        if (lastCrash.trace[core][ix].taskID != 0) {
+            pWatchdog->trace[i] = lastCrash.trace[core][ix];
+            pWatchdog->traceCount++;
+        }
+        else {
+            pWatchdog->trace[i].taskID = 0;
+            pWatchdog->trace[i].runTime = 0;
+        }
+
+        ix = (ix + CRASH_TRACE_LENGTH - 1) % CRASH_TRACE_LENGTH;
+    }
+
+    isReportPending = false;
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "packet.h"
+
+#ifndef __INCL_CRASH
+#define __INCL_CRASH
+
+#define CRASH_MAGIC                         0xC0DEFA11
+
+/*
+** The reset reason sent in the watchdog packet, power on & watchdog
+** come from persist.h...
+*/
+#define CRASH_REASON_NONE                   0xFF
+#define CRASH_REASON_SCHED_ERROR            0x02
+#define CRASH_REASON_TASK_STALLED           0x03
+
+#define CRASH_NO_TASK                       0xFFFF
+#define CRASH_TIME_UNKNOWN                  0xFFFFFFFF
+
+#define CRASH_TRACE_LENGTH                  WATCHDOG_TRACE_LENGTH
+
+typedef struct {
+    uint16_t            taskID;
+    uint16_t            reserved;
+    uint32_t            startTime;
+}
+crash_task_t;
+
+/*
+** Kept in RAM that isn't cleared at boot, so it survives the watchdog
+** reset. It is only trusted after a watchdog reset...
+*/
+typedef struct {
+    uint32_t            magic;
+
+    uint8_t             reason;
+    uint8_t             reserved;
+    uint16_t            errorCode;
+    uint32_t            errorTime;
+
+    crash_task_t        running[2];
+
+    watchdog_trace_t    trace[2][CRASH_TRACE_LENGTH];
+    uint8_t             traceIndex[2];
+}
+crash_record_t;
+
+void        crashInit(void);
+void        crashRecordError(unsigned int code);
+void        crashRecordStalledTask(uint16_t taskID);
+bool        crashGetReport(watchdog_packet_t * pWatchdog);
+
+#endif
@@ -2,8 +2,11 @@
 #include <stdlib.h>
 
 #include "pico/stdlib.h"
+#include "hardware/watchdog.h"
 #include "schederr.h"
 #include "utils.h"
+#include "persist.h"
+#include "crash.h"
 
 void _handleNoFreeTasks()
 {
@@ -63,5 +66,16 @@ void handleError(unsigned int code)
 			break;
 	}
 
-    exit(-1);
+    /*
+    ** Record what happened for the watchdog packet we send when
+    ** we come back up, then reboot...
+    */
+    crashRecordError(code);
+    persistSaveScratch();
+
+    watchdog_reboot(0, 0, 0);
+
+    while (1) {
+        tight_loop_contents();
+    }
 }
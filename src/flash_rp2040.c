@@ -0,0 +1,211 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef UNIT_TEST_MODE
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "scheduler.h"
+#endif
+
+#include "flash_rp2040.h"
+
+#define FLASH_ERASED_BYTE                   0xFF
+
+static bool _isValidRange(uint32_t offset, uint32_t length) {
+    return (offset < PICO_FLASH_SIZE_BYTES && length <= (PICO_FLASH_SIZE_BYTES - offset));
+}
+
+#ifdef UNIT_TEST_MODE
+/*
+** Simulates NOR flash on the host: an erase sets a whole sector to 0xFF,
+** programming can only clear bits. A power failure part way through a 
+** program can be simulated with flashSimSetFailAfter()...
+*/
+static uint8_t              flashSim[PICO_FLASH_SIZE_BYTES];
+static uint32_t             eraseCount[PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE];
+static int32_t              failAfter = -1;
+
+void flashSimReset(void) {
+    memset(flashSim, FLASH_ERASED_BYTE, sizeof(flashSim));
+    memset(eraseCount, 0, sizeof(eraseCount));
+    failAfter = -1;
+}
+
+/*
+** Stop programming after byteCount more bytes, as if the power failed.
+** Pass -1 to turn this off...
+*/
+void flashSimSetFailAfter(int32_t byteCount) {
+    failAfter = byteCount;
+}
+
+uint32_t flashSimGetEraseCount(uint32_t offset) {
+    return eraseCount[offset / FLASH_SECTOR_SIZE];
+}
+
+static const uint8_t * _getReadAddress(uint32_t offset) {
+    return &flashSim[offset];
+}
+
+static void _erase(uint32_t offset) {
+    if (failAfter == 0) {
+        return;
+    }
+
+    memset(&flashSim[offset], FLASH_ERASED_BYTE, FLASH_SECTOR_SIZE);
+    eraseCount[offset / FLASH_SECTOR_SIZE]++;
+}
+
+static void _program(uint32_t offset, const uint8_t * buffer, uint32_t length) {
+    uint32_t            i;
+
+    for (i = 0;i < length;i++) {
+        if (failAfter == 0) {
+            return;
+        }
+        else if (failAfter > 0) {
+            failAfter--;
+        }
+
+        flashSim[offset + i] &= buffer[i];
+    }
+}
+#else
+/*
+** Read through the uncached XIP alias, so we don't evict the code we're
+** running from the XIP cache...
+*/
+static const uint8_t * _getReadAddress(uint32_t offset) {
+    return (const uint8_t *)(XIP_NOCACHE_NOALLOC_BASE + offset);
+}
+
+/*
+** Nothing can run from flash while it is being erased or programmed, so
+** park core 1 and disable interrupts on this core...
+*/
+static void _erase(uint32_t offset) {
+    uint32_t            status;
+
+    lockoutOtherCore();
+    status = save_and_disable_interrupts();
+
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+
+    restore_interrupts(status);
+    releaseOtherCore();
+}
+
+/*
+** The flash can only be programmed a whole page at a time, programming 
+** a byte with 0xFF leaves it unchanged so pad the rest of the page...
+*/
+static void _program(uint32_t offset, const uint8_t * buffer, uint32_t length) {
+    uint8_t             page[FLASH_PAGE_SIZE];
+    uint32_t            pageOffset;
+    uint32_t            start;
+    uint32_t            count;
+    uint32_t            status;
+
+    while (length > 0) {
+        pageOffset = offset & ~(FLASH_PAGE_SIZE - 1);
+        start = offset - pageOffset;
+        count = FLASH_PAGE_SIZE - start;
+
+        if (count > length) {
+            count = length;
+        }
+
+        memset(page, FLASH_ERASED_BYTE, FLASH_PAGE_SIZE);
+        memcpy(&page[start], buffer, count);
+
+        lockoutOtherCore();
+        status = save_and_disable_interrupts();
+
+        flash_range_program(pageOffset, page, FLASH_PAGE_SIZE);
+
+        restore_interrupts(status);
+        releaseOtherCore();
+
+        offset += count;
+        buffer += count;
+        length -= count;
+    }
+}
+#endif
+
+/*
+** CRC16-CCITT, for checking records we've written to the flash...
+*/
+uint16_t flashCRC16(const uint8_t * data, int length) {
+    uint16_t            crc = 0xFFFF;
+    int                 i;
+    int                 bit;
+
+    for (i = 0;i < length;i++) {
+        crc ^= (uint16_t)data[i] << 8;
+
+        for (bit = 0;bit < 8;bit++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+int flashRead(uint32_t offset, uint8_t * buffer, uint32_t length) {
+    if (!_isValidRange(offset, length)) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    memcpy(buffer, _getReadAddress(offset), length);
+
+    return 0;
+}
+
+bool flashIsErased(uint32_t offset, uint32_t length) {
+    const uint8_t *     p;
+    uint32_t            i;
+
+    if (!_isValidRange(offset, length)) {
+        return false;
+    }
+
+    p = _getReadAddress(offset);
+
+    for (i = 0;i < length;i++) {
+        if (p[i] != FLASH_ERASED_BYTE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+** Erase the 4K sector at offset, which must be sector aligned...
+*/
+int flashEraseSector(uint32_t offset) {
+    if ((offset & (FLASH_SECTOR_SIZE - 1)) != 0 || !_isValidRange(offset, FLASH_SECTOR_SIZE)) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    _erase(offset);
+
+    return 0;
+}
+
+/*
+** Program any number of bytes at any offset, the bytes must have been
+** erased first as programming can only clear bits...
+*/
+int flashProgram(uint32_t offset, const uint8_t * buffer, uint32_t length) {
+    if (!_isValidRange(offset, length)) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    _program(offset, buffer, length);
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef UNIT_TEST_MODE
+#include "hardware/flash.h"
+#endif
+
+#ifndef __INCL_FLASH_RP2040
+#define __INCL_FLASH_RP2040
+
+#ifdef UNIT_TEST_MODE
+#define FLASH_PAGE_SIZE                     (1U << 8)
+#define FLASH_SECTOR_SIZE                   (1U << 12)
+
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES               (2 * 1024 * 1024)
+#endif
+
+#ifndef PICO_ERROR_GENERIC
+#define PICO_ERROR_GENERIC                  -1
+#define PICO_ERROR_INVALID_ARG              -5
+#endif
+#endif
+
+/*
+** Offsets are from the start of the flash, not the XIP address...
+*/
+int         flashRead(uint32_t offset, uint8_t * buffer, uint32_t length);
+int         flashEraseSector(uint32_t offset);
+int         flashProgram(uint32_t offset, const uint8_t * buffer, uint32_t length);
+bool        flashIsErased(uint32_t offset, uint32_t length);
+uint16_t    flashCRC16(const uint8_t * data, int length);
+
+#ifdef UNIT_TEST_MODE
+void        flashSimReset(void);
+void        flashSimSetFailAfter(int32_t byteCount);
+uint32_t    flashSimGetEraseCount(uint32_t offset);
+#endif
+
+#endif
@@ -0,0 +1,394 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "rtc_rp2040.h"
+#include "radio.h"
+#include "packet.h"
+#include "flash_rp2040.h"
+#include "flashlog.h"
+
+#define RECORDS_PER_SECTOR                  (FLASH_SECTOR_SIZE / FLASHLOG_RECORD_SIZE)
+
+#define SEQUENCE_ERASED                     0xFFFFFFFF
+#define AGE_UNKNOWN                         0xFFFFFFFF
+
+/*
+** Records are appended at the head & uploaded from the tail. A record 
+** is only valid if its CRC checks out, so a record torn by a power 
+** failure is skipped over rather than uploaded. The sector at the head
+** is erased as we move into it, which drops the oldest records, so 
+** every sector is erased equally often...
+*/
+static uint32_t             headSlot = 0;
+static uint32_t             tailSlot = 0;
+static uint32_t             nextSequence = 0;
+static uint32_t             pendingCount = 0;
+
+/*
+** Records queued with the radio in this send, they're only marked as 
+** uploaded by flashLogConfirm() once the base station has ACKed them...
+*/
+static uint32_t             inFlight[RADIO_QUEUE_LENGTH];
+static int                  inFlightCount = 0;
+static uint32_t             lastSlot = 0;
+static bool                 isLastSlotValid = false;
+
+/*
+** The first record written since the scheduler clock last started, 
+** older records were stamped by a clock that has since been reset or 
+** stopped, so their age isn't known...
+*/
+static uint32_t             bootSequence = 0;
+
+static uint16_t _getRecordCRC(const flashlog_record_t * r) {
+    flashlog_record_t   copy;
+
+    memcpy(&copy, r, sizeof(flashlog_record_t));
+
+    copy.crc = 0xFFFF;
+    copy.uploaded = FLASHLOG_NOT_UPLOADED;
+
+    return flashCRC16((const uint8_t *)&copy, sizeof(flashlog_record_t));
+}
+
+static inline uint32_t _getSlotOffset(uint32_t slot) {
+    return FLASHLOG_OFFSET + (slot * FLASHLOG_RECORD_SIZE);
+}
+
+static inline uint32_t _nextSlot(uint32_t slot) {
+    return (slot + 1) % FLASHLOG_RECORD_COUNT;
+}
+
+static inline bool _isPending(const flashlog_record_t * r) {
+    return (r->uploaded == FLASHLOG_NOT_UPLOADED);
+}
+
+static bool _readRecord(uint32_t slot, flashlog_record_t * r) {
+    if (flashRead(_getSlotOffset(slot), (uint8_t *)r, sizeof(flashlog_record_t))) {
+        return false;
+    }
+
+    return (r->sequence != SEQUENCE_ERASED && r->crc == _getRecordCRC(r));
+}
+
+static bool _isInFlight(uint32_t slot) {
+    int                 i;
+
+    for (i = 0;i < inFlightCount;i++) {
+        if (inFlight[i] == slot) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t _getMinute(void) {
+    return (uint32_t)(getRTCClock() / RTC_ONE_MINUTE);
+}
+
+/*
+** Erase the sector we're moving the head into, dropping the oldest
+** records in the log...
+*/
+static int _prepareSector(uint32_t slot) {
+    flashlog_record_t   r;
+    uint32_t            first;
+    uint32_t            s;
+    int                 error;
+
+    if (flashIsErased(_getSlotOffset(slot), FLASH_SECTOR_SIZE)) {
+        return 0;
+    }
+
+    first = slot - (slot % RECORDS_PER_SECTOR);
+
+    for (s = first;s < (first + RECORDS_PER_SECTOR);s++) {
+        if (_readRecord(s, &r) && _isPending(&r) && pendingCount > 0) {
+            pendingCount--;
+        }
+    }
+
+    error = flashEraseSector(_getSlotOffset(first));
+
+    if (error) {
+        return error;
+    }
+
+    if (tailSlot >= first && tailSlot < (first + RECORDS_PER_SECTOR)) {
+        tailSlot = (first + RECORDS_PER_SECTOR) % FLASHLOG_RECORD_COUNT;
+    }
+
+    return 0;
+}
+
+/*
+** Scan the log for where we left off, we can't trust anything we kept
+** in RAM across a reset...
+*/
+int flashLogInit(void) {
+    flashlog_record_t   r;
+    uint32_t            slot;
+    uint32_t            maxSequence = 0;
+    uint32_t            minPending = SEQUENCE_ERASED;
+    bool                isFound = false;
+
+    headSlot = 0;
+    tailSlot = 0;
+    nextSequence = 0;
+    pendingCount = 0;
+    inFlightCount = 0;
+    isLastSlotValid = false;
+
+    for (slot = 0;slot < FLASHLOG_RECORD_COUNT;slot++) {
+        if (!_readRecord(slot, &r)) {
+            continue;
+        }
+
+        if (!isFound || r.sequence > maxSequence) {
+            maxSequence = r.sequence;
+            headSlot = _nextSlot(slot);
+            isFound = true;
+        }
+
+        if (_isPending(&r)) {
+            pendingCount++;
+
+            if (r.sequence < minPending) {
+                minPending = r.sequence;
+                tailSlot = slot;
+            }
+        }
+    }
+
+    if (isFound) {
+        nextSequence = maxSequence + 1;
+    }
+
+    if (pendingCount == 0) {
+        tailSlot = headSlot;
+    }
+
+    bootSequence = nextSequence;
+
+    return 0;
+}
+
+/*
+** Add a reading to the log, it stays pending until the base station 
+** ACKs it, whether it is sent live or later from the log...
+*/
+int flashLogAppend(weather_packet_t * pWeather) {
+    flashlog_record_t   r;
+    uint32_t            tries;
+    int                 error;
+
+    /*
+    ** Anything left in flight by a send that never finished stays 
+    ** pending & goes again...
+    */
+    inFlightCount = 0;
+    isLastSlotValid = false;
+
+    memset(&r, 0, sizeof(flashlog_record_t));
+
+    r.sequence = nextSequence;
+    r.status = pWeather->status;
+    r.minute = _getMinute();
+    r.rawBatteryPercentage = pWeather->rawBatteryPercentage;
+    r.rawBatteryVolts = pWeather->rawBatteryVolts;
+    r.rawTemperature = pWeather->rawTemperature;
+    r.rawHumidity = pWeather->rawHumidity;
+    r.rawICPPressure = pWeather->rawICPPressure;
+    r.rawRainfall = pWeather->rawRainfall;
+    r.rawWindspeed = pWeather->rawWindspeed;
+    r.rawWindGust = pWeather->rawWindGust;
+
+    r.crc = _getRecordCRC(&r);
+    r.uploaded = FLASHLOG_NOT_UPLOADED;
+
+    /*
+    ** Find an erased slot, skipping any torn by a power failure...
+    */
+    for (tries = 0;tries < FLASHLOG_RECORD_COUNT;tries++) {
+        if ((headSlot % RECORDS_PER_SECTOR) == 0) {
+            error = _prepareSector(headSlot);
+
+            if (error) {
+                return error;
+            }
+        }
+
+        if (flashIsErased(_getSlotOffset(headSlot), FLASHLOG_RECORD_SIZE)) {
+            break;
+        }
+
+        headSlot = _nextSlot(headSlot);
+    }
+
+    error = flashProgram(_getSlotOffset(headSlot), (const uint8_t *)&r, sizeof(flashlog_record_t));
+
+    if (error) {
+        return error;
+    }
+
+    if (pendingCount == 0) {
+        tailSlot = headSlot;
+    }
+
+    pendingCount++;
+
+    lastSlot = headSlot;
+    isLastSlotValid = true;
+
+    headSlot = _nextSlot(headSlot);
+    nextSequence++;
+
+    return 0;
+}
+
+/*
+** Queue the reading just appended as the live packet in buf, it is
+** marked as uploaded if the base station ACKs it...
+*/
+int flashLogSendLive(uint8_t * buf, int length) {
+    int                 error;
+
+    if (!isLastSlotValid || inFlightCount >= RADIO_QUEUE_LENGTH) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    error = radioQueueAckPacket(buf, length, (uint16_t)lastSlot);
+
+    if (error) {
+        return error;
+    }
+
+    inFlight[inFlightCount++] = lastSlot;
+    isLastSlotValid = false;
+
+    return 0;
+}
+
+/*
+** Queue up to maxCount of the oldest readings not yet sent with the
+** radio, oldest first, skipping any already queued. Returns the number 
+** queued...
+*/
+int flashLogUpload(int maxCount) {
+    flashlog_record_t   r;
+    weather_log_packet_t    packet;
+    uint32_t            scanned;
+    uint32_t            slot;
+    uint32_t            seen = 0;
+    uint32_t            minute;
+    int                 count = 0;
+
+    minute = _getMinute();
+    slot = tailSlot;
+
+    for (scanned = 0;scanned < FLASHLOG_RECORD_COUNT && seen < pendingCount && count < maxCount;scanned++) {
+        if (_readRecord(slot, &r) && _isPending(&r)) {
+            /*
+            ** Everything before the first pending record has gone...
+            */
+            if (seen++ == 0) {
+                tailSlot = slot;
+            }
+
+            if (_isInFlight(slot) || inFlightCount >= RADIO_QUEUE_LENGTH) {
+                slot = _nextSlot(slot);
+                continue;
+            }
+
+            memset(&packet, 0, sizeof(weather_log_packet_t));
+
+            packet.packetID = PACKET_ID_WEATHER_LOG;
+            packet.sequence[0] = (uint8_t)(r.sequence & 0xFF);
+            packet.sequence[1] = (uint8_t)((r.sequence >> 8) & 0xFF);
+            packet.sequence[2] = (uint8_t)((r.sequence >> 16) & 0xFF);
+            packet.status = r.status;
+            packet.rawBatteryPercentage = r.rawBatteryPercentage;
+            packet.rawBatteryVolts = r.rawBatteryVolts;
+            packet.rawTemperature = r.rawTemperature;
+            packet.rawHumidity = r.rawHumidity;
+            packet.rawICPPressure = r.rawICPPressure;
+            packet.rawRainfall = r.rawRainfall;
+            packet.rawWindspeed = r.rawWindspeed;
+            packet.rawWindGust = r.rawWindGust;
+
+            /*
+            ** The scheduler clock restarts from zero when we reset & 
+            ** stops while we sleep...
+            */
+            if (r.sequence >= bootSequence && minute >= r.minute) {
+                packet.ageMinutes = minute - r.minute;
+            }
+            else {
+                packet.ageMinutes = AGE_UNKNOWN;
+            }
+
+            if (radioQueueAckPacket((uint8_t *)&packet, sizeof(weather_log_packet_t), (uint16_t)slot)) {
+                break;
+            }
+
+            inFlight[inFlightCount++] = slot;
+            count++;
+        }
+
+        slot = _nextSlot(slot);
+    }
+
+    return count;
+}
+
+/*
+** Called once the radio has finished, marks the records the base 
+** station ACKed as uploaded. The rest stay pending for the next send...
+*/
+void flashLogConfirm(void) {
+    flashlog_record_t   r;
+    uint16_t            tags[RADIO_QUEUE_LENGTH];
+    uint8_t             uploaded = FLASHLOG_UPLOADED;
+    int                 ackCount;
+    int                 i;
+
+    ackCount = radioGetAckedTags(tags, RADIO_QUEUE_LENGTH);
+
+    for (i = 0;i < ackCount;i++) {
+        if (!_isInFlight(tags[i])) {
+            continue;
+        }
+
+        if (_readRecord(tags[i], &r) && _isPending(&r) && pendingCount > 0) {
+            flashProgram(
+                    _getSlotOffset(tags[i]) + offsetof(flashlog_record_t, uploaded), 
+                    &uploaded, 
+                    1);
+
+            pendingCount--;
+        }
+    }
+
+    inFlightCount = 0;
+    isLastSlotValid = false;
+
+    if (pendingCount == 0) {
+        tailSlot = headSlot;
+    }
+}
+
+/*
+** Called on waking from sleep, the scheduler clock stopped while we 
+** slept so the minutes on the records before now can't give their age...
+*/
+void flashLogNewEpoch(void) {
+    bootSequence = nextSequence;
+}
+
+uint32_t flashLogGetPendingCount(void) {
+    return pendingCount;
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash_rp2040.h"
+#include "packet.h"
+
+#ifndef __INCL_FLASHLOG
+#define __INCL_FLASHLOG
+
+/*
+** The log is a ring of sectors at the top of the flash, well clear of
+** the program. At one record every 4 minutes 64K holds about 5 days...
+*/
+#define FLASHLOG_SECTOR_COUNT               16
+#define FLASHLOG_SIZE                       (FLASHLOG_SECTOR_COUNT * FLASH_SECTOR_SIZE)
+#define FLASHLOG_OFFSET                     (PICO_FLASH_SIZE_BYTES - FLASHLOG_SIZE)
+
+#define FLASHLOG_RECORD_SIZE                32
+#define FLASHLOG_RECORD_COUNT               (FLASHLOG_SIZE / FLASHLOG_RECORD_SIZE)
+
+/*
+** Most logged records we send with each live packet, fewer if the radio
+** queue hasn't the room, see radioGetQueueSpace()...
+*/
+#define FLASHLOG_UPLOAD_BATCH               2
+
+#define FLASHLOG_UPLOADED                   0x00
+#define FLASHLOG_NOT_UPLOADED               0xFF
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t            sequence;
+    uint16_t            crc;                        // CRC16 of the record with uploaded = 0xFF
+    uint8_t             uploaded;                   // 0xFF until sent, then programmed to 0x00
+    uint8_t             status;
+
+    uint32_t            minute;                     // Scheduler minute when the reading was taken
+
+    uint8_t             rawBatteryPercentage;
+    uint8_t             reserved;
+    uint16_t            rawBatteryVolts;
+
+    int16_t             rawTemperature;
+    uint16_t            rawHumidity;
+    uint32_t            rawICPPressure;
+
+    uint16_t            rawRainfall;
+    uint16_t            rawWindspeed;
+    uint16_t            rawWindGust;
+
+    uint8_t             padding[2];
+}
+flashlog_record_t;
+#pragma pack(pop)
+
+int         flashLogInit(void);
+int         flashLogAppend(weather_packet_t * pWeather);
+int         flashLogSendLive(uint8_t * buf, int length);
+int         flashLogUpload(int maxCount);
+void        flashLogConfirm(void);
+void        flashLogNewEpoch(void);
+uint32_t    flashLogGetPendingCount(void);
+
+#endif
@@ -3,7 +3,51 @@
 
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
+#include "scheduler.h"
 #include "gpio_def.h"
+#include "gpio_cntrl.h"
+
+typedef struct {
+    uint            gpio;
+    uint16_t        taskID;
+}
+gpio_signal_t;
+
+static gpio_signal_t        gpioSignals[GPIO_SIGNAL_MAX];
+static int                  gpioSignalCount = 0;
+
+/*
+** The SDK has a single GPIO callback per core, so all the edge
+** interrupts come through here and signal the task for the pin...
+*/
+static void _gpioIRQCallback(uint gpio, uint32_t events) {
+    int             i;
+
+    for (i = 0;i < gpioSignalCount;i++) {
+        if (gpioSignals[i].gpio == gpio) {
+            signalTask(gpioSignals[i].taskID);
+        }
+    }
+}
+
+/*
+** Signal the task whenever one of the edges (GPIO_IRQ_EDGE_RISE and/or
+** GPIO_IRQ_EDGE_FALL) is seen on the pin, so the task can react to the
+** pin changing rather than polling it...
+*/
+int gpioSignalTaskOnEdge(uint gpio, uint32_t edges, uint16_t taskID) {
+    if (gpioSignalCount >= GPIO_SIGNAL_MAX) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    gpioSignals[gpioSignalCount].gpio = gpio;
+    gpioSignals[gpioSignalCount].taskID = taskID;
+    gpioSignalCount++;
+
+    gpio_set_irq_enabled_with_callback(gpio, edges, true, &_gpioIRQCallback);
+
+    return PICO_OK;
+}
 
 void initGPIOs(void) {
     /*
@@ -12,6 +56,11 @@ void initGPIOs(void) {
     gpio_set_function(I2C0_SDA_ALT_PIN, GPIO_FUNC_I2C);
     gpio_set_function(I2C0_SLK_ALT_PIN, GPIO_FUNC_I2C);
 
+#ifdef I2C_DUAL_BUS
+    gpio_set_function(I2C1_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(I2C1_SCL_PIN, GPIO_FUNC_I2C);
+#endif
+
     /*
     ** SPI CSn
     */
@@ -60,6 +109,10 @@ void deInitGPIOs(void) {
             (1 << NRF24L01_SPI_PIN_SCK) |
             (1 << I2C0_POWER_PIN_0);
 
+#ifdef I2C_DUAL_BUS
+    pinMask |= (1 << I2C1_SDA_PIN) | (1 << I2C1_SCL_PIN);
+#endif
+
     gpio_init_mask(pinMask);
     gpio_set_dir_out_masked(pinMask);
 
@@ -72,6 +125,11 @@ void deInitGPIOs(void) {
     gpio_disable_pulls(NRF24L01_SPI_PIN_SCK);    
     gpio_disable_pulls(I2C0_POWER_PIN_0);    
 
+#ifdef I2C_DUAL_BUS
+    gpio_disable_pulls(I2C1_SDA_PIN);    
+    gpio_disable_pulls(I2C1_SCL_PIN);    
+#endif
+
     gpio_clr_mask(pinMask);
 }
 
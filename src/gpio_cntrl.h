@@ -1,11 +1,20 @@
+#include <stdint.h>
+
+#include "pico/stdlib.h"
 #include "gpio_def.h"
 
 #ifndef __INCL_GPIO_CNTRL
 #define __INCL_GPIO_CNTRL
 
+/*
+** Max number of pins that can signal a task...
+*/
+#define GPIO_SIGNAL_MAX                     4
+
 void initGPIOs(void);
 void initDebugPins(void);
 void deInitGPIOs(void);
 void deInitGPIOsAndDebugPins(void);
+int  gpioSignalTaskOnEdge(uint gpio, uint32_t edges, uint16_t taskID);
 
 #endif
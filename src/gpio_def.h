@@ -35,6 +35,9 @@
 #define I2C0_SDA_ALT_PIN			16
 #define I2C0_SLK_ALT_PIN			17
 
+#define I2C1_SDA_PIN                14
+#define I2C1_SCL_PIN                15
+
 #define PIO_PIN_ANEMOMETER          11
 #define PIO_PIN_RAIN_GAUGE          13
 
@@ -49,6 +52,8 @@
 
 #define I2C0_POWER_PIN_0            18
 
+#define MAX17048_ALERT_PIN          19
+
 #define DEBUG_ENABLE_PIN            12
 #define SCOPE_DEBUG_PIN_0           20
 #define SCOPE_DEBUG_PIN_1           21
@@ -36,10 +36,11 @@ void HeartbeatTask(PTASKPARM p) {
         }
     }
     else {
-        scheduleTask(
-                TASK_HEARTBEAT, 
-                rtc_val_sec(1), 
-                false,
-                NULL);
+        /*
+        ** Stop until taskDebugCheck() restarts us, rather than waking
+        ** every second to check the debug pin...
+        */
+        turnOff(ONBAORD_LED_PIN);
+        on = 0;
     }
 }
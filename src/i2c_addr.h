@@ -9,4 +9,12 @@
 #define LTR390_ADDRESS                      0x53
 #define MAX17048_ADDRESS                    0x36
 
+/*
+** The fastest bus speed each device supports, from the datasheets...
+*/
+#define ICP10125_MAX_BAUDRATE               400000
+#define SHT4X_MAX_BAUDRATE                 1000000
+#define TMP117_MAX_BAUDRATE                 400000
+#define MAX17048_MAX_BAUDRATE               400000
+
 #endif
@@ -14,68 +14,200 @@
 #include "taskdef.h"
 #include "rtc_rp2040.h"
 #include "i2c_rp2040.h"
+#include "clock_rp2040.h"
 #include "gpio_def.h"
 
 #define I2C_BUS_MIN_DEVICES              1
 #define I2C_BUS_MAX_DEVICES              8
 #define I2C_TIMEOUT_US                2500
+#define I2C_TIMEOUT_PER_BYTE_US        100
+#define I2C_PROBE_ATTEMPTS               3
+#define I2C_FIFO_DEPTH                  16
 
-static i2c_device_t         devices_i2c0[I2C_BUS_MAX_DEVICES];
-static i2c_device_t         devices_i2c1[I2C_BUS_MAX_DEVICES];
+#define I2C_ADDRESS_COUNT              128
+#define I2C_NO_DEVICE                 0xFF
 
-static int                  numDevicesOnBus[2];
+typedef struct {
+    uint                    sda;
+    uint                    scl;
+}
+i2c_pins_t;
+
+/*
+** The transfer in progress on a bus, mostly driven from the interrupt...
+*/
+typedef struct {
+    const i2c_segment_t *   tx;
+    int                     txCount;
+    const i2c_segment_t *   rx;
+    int                     rxCount;
+    size_t                  txTotal;
+    size_t                  rxTotal;
+
+    /*
+    ** The next byte to queue a command for, & the next to read into...
+    */
+    int                     cmdSeg;
+    size_t                  cmdIndex;
+    size_t                  cmdCount;
+    int                     rxSeg;
+    size_t                  rxIndex;
+    size_t                  rxReceived;
+
+    uint                    address;
+    uint64_t                deadline;
+
+    volatile bool           isAborted;
+    volatile bool           isBusy;
+}
+i2c_xfer_t;
 
-static i2c_device_t * i2cGetDeviceByAddress(i2c_inst_t * i2c, uint address) {
-    i2c_device_t *          devices;
-    i2c_device_t *          device;
+/*
+** Everything we know about a bus. Devices are found by indexing the
+** 7-bit address straight into addressIndex, rather than searching...
+*/
+typedef struct {
+    i2c_device_t            devices[I2C_BUS_MAX_DEVICES];
+    uint8_t                 addressIndex[I2C_ADDRESS_COUNT];
+
+    int                     maxDevices;
     int                     numDevices;
-    int                     i;
 
-    if (i2c == i2c0) {
-        devices = devices_i2c0;
-        numDevices = numDevicesOnBus[0];
-    }
-    else if (i2c == i2c1) {
-        devices = devices_i2c1;
-        numDevices = numDevicesOnBus[1];
-    }
-    else {
+    i2c_pins_t              pins;
+    uint8_t                 recoveryCount;
+
+    uint                    baudrate;
+    bool                    isNegotiating;
+
+    i2c_xfer_t              xfer;
+    bool                    isIRQInstalled;
+    bool                    isPending;
+    bool                    isAsync;
+    int                     asyncResult;
+}
+i2c_bus_t;
+
+typedef struct {
+    uint                    baudrate;
+    uint32_t                minSysKHz;
+}
+i2c_speed_t;
+
+/*
+** The speeds we try, fastest first, with the slowest clk_sys the 
+** controller can generate each one from (RP2040 datasheet 4.3)...
+*/
+static const i2c_speed_t    speeds[I2C_NUM_SPEEDS] = {
+    {I2C_BAUDRATE_FAST_PLUS,    32000},
+    {I2C_BAUDRATE_FAST,         12000},
+    {I2C_BAUDRATE_STANDARD,      2700}
+};
+
+static i2c_bus_t            buses[NUM_I2CS] = {
+    {.pins = {I2C0_SDA_ALT_PIN, I2C0_SLK_ALT_PIN}},
+    {.pins = {I2C1_SDA_PIN, I2C1_SCL_PIN}}
+};
+
+static inline i2c_bus_t * i2cGetBus(i2c_inst_t * i2c) {
+    return &buses[i2c_get_index(i2c)];
+}
+
+static inline i2c_device_t * i2cGetDeviceByAddress(i2c_inst_t * i2c, uint address) {
+    i2c_bus_t *             bus = i2cGetBus(i2c);
+    uint8_t                 ix;
+
+    if (address >= I2C_ADDRESS_COUNT) {
         return NULL;
     }
 
-    for (i = 0;i < numDevices;i++) {
-        device = &devices[i];
+    ix = bus->addressIndex[address];
 
-        if (device->address == address) {
-            return device;
-        }
+    return (ix == I2C_NO_DEVICE ? NULL : &bus->devices[ix]);
+}
+
+/*
+** A device that fails is marked inactive & left alone until its backoff
+** has expired, so a missing or flaky device doesn't cost us a timeout 
+** on every access...
+*/
+static void i2cRecordError(i2c_device_t * device) {
+    if (device->consecutiveErrors < UINT8_MAX) {
+        device->consecutiveErrors++;
     }
 
-    return NULL;
+    if (device->isActive) {
+        device->backoff = I2C_BACKOFF_MIN;
+    }
+    else if (device->backoff < (I2C_BACKOFF_MAX / 2)) {
+        device->backoff *= 2;
+    }
+    else {
+        device->backoff = I2C_BACKOFF_MAX;
+    }
+
+    device->isActive = false;
+    device->lastStateTime = getRTCClock();
 }
 
-static void i2cSetDeviceState(i2c_inst_t * i2c, uint address, bool state) {
-    i2c_device_t *          device;
+static void i2cRecordSuccess(i2c_device_t * device) {
+    device->consecutiveErrors = 0;
+    device->isActive = true;
+    device->lastStateTime = getRTCClock();
+}
 
-    device = i2cGetDeviceByAddress(i2c, address);
+static bool i2cIsBackingOff(i2c_device_t * device) {
+    return (!device->isActive && getRTCClock() < (device->lastStateTime + device->backoff));
+}
 
-    if (device != NULL) {
-        device->isActive = state;
-        device->lastStateTime = getRTCClock();
+/*
+** A device reset part way through a read can be left holding SDA low
+** waiting for more clocks. Clock SCL by hand (up to 9 times) until it 
+** lets go of SDA, then send a STOP. Returns true if the bus is free...
+*/
+bool i2cBusRecover(i2c_inst_t * i2c) {
+    i2c_bus_t *         bus = i2cGetBus(i2c);
+    i2c_pins_t *        pins = &bus->pins;
+    int                 i;
+    bool                isFree;
+
+    if (bus->recoveryCount < I2C_HEALTH_RECOVERY_MAX) {
+        bus->recoveryCount++;
     }
-}
 
-static bool i2cIsDeviceActive(i2c_inst_t * i2c, uint address) {
-    int             error;
-    uint8_t         rxData;
+    /*
+    ** Drive the pins open drain, e.g. pull low or let the pull up
+    ** take the line high...
+    */
+    gpio_put(pins->sda, false);
+    gpio_put(pins->scl, false);
+    gpio_set_dir(pins->sda, GPIO_IN);
+    gpio_set_dir(pins->scl, GPIO_IN);
+    gpio_set_function(pins->sda, GPIO_FUNC_SIO);
+    gpio_set_function(pins->scl, GPIO_FUNC_SIO);
+
+    for (i = 0;i < 9 && !gpio_get(pins->sda);i++) {
+        gpio_set_dir(pins->scl, GPIO_OUT);
+        busy_wait_us_32(5);
+        gpio_set_dir(pins->scl, GPIO_IN);
+        busy_wait_us_32(5);
+    }
 
-    error = i2c_read_timeout_us(i2c, address, &rxData, 1, false, I2C_TIMEOUT_US);
+    /*
+    ** STOP, SDA goes high while SCL is high...
+    */
+    gpio_set_dir(pins->sda, GPIO_OUT);
+    busy_wait_us_32(5);
+    gpio_set_dir(pins->sda, GPIO_IN);
+    busy_wait_us_32(5);
 
-    if (error == PICO_ERROR_GENERIC || error == PICO_ERROR_TIMEOUT) {
-        return false;
-    }
+    isFree = gpio_get(pins->sda);
 
-    return true;
+    gpio_set_function(pins->sda, GPIO_FUNC_I2C);
+    gpio_set_function(pins->scl, GPIO_FUNC_I2C);
+
+    lgLogError("I2C%d bus recovery %s", i2c_get_index(i2c), (isFree ? "OK" : "failed"));
+
+    return isFree;
 }
 
 void i2cBusPowerUp(void) {
@@ -98,288 +230,661 @@ bool i2cGetDeviceState(i2c_inst_t * i2c, uint address) {
     return false;
 }
 
-int i2c_bus_open(i2c_inst_t * i2c, int numDevices) {
-    i2c_device_t *          devices;
+/*
+** A summary of the bus health for the weather packet, reading it clears
+** the recovery count...
+*/
+uint8_t i2cGetBusHealth(i2c_inst_t * i2c) {
+    i2c_bus_t *             bus = i2cGetBus(i2c);
+    int                     i;
+    uint8_t                 health = 0;
 
-    if (numDevices < I2C_BUS_MIN_DEVICES || numDevices > I2C_BUS_MAX_DEVICES) {
-        return -1;
+    for (i = 0;i < bus->numDevices && i < 4;i++) {
+        if (!bus->devices[i].isActive) {
+            health |= (1 << i);
+        }
     }
 
-    if (i2c == i2c0) {
-        devices = devices_i2c0;
-        numDevicesOnBus[0] = numDevices;
-    }
-    else if (i2c == i2c1) {
-        devices = devices_i2c1;
-        numDevicesOnBus[1] = numDevices;
-    }
-    else {
-        return -1;
-    }
+    health |= (bus->recoveryCount << I2C_HEALTH_RECOVERY_SHIFT);
+    bus->recoveryCount = 0;
+
+    return health;
+}
+
+/*
+** Start registering devices on the bus afresh...
+*/
+int i2c_bus_open(i2c_inst_t * i2c, int maxDevices) {
+    i2c_bus_t *             bus = i2cGetBus(i2c);
 
-    if (devices == NULL) {
-        return -1;
+    if (maxDevices < I2C_BUS_MIN_DEVICES || maxDevices > I2C_BUS_MAX_DEVICES) {
+        return PICO_ERROR_INVALID_ARG;
     }
 
-    memset(devices, 0, sizeof(i2c_device_t) * numDevices);
+    memset(bus->devices, 0, sizeof(bus->devices));
+    memset(bus->addressIndex, I2C_NO_DEVICE, sizeof(bus->addressIndex));
+
+    bus->maxDevices = maxDevices;
+    bus->numDevices = 0;
 
     return 0;
 }
 
 int i2c_bus_close(i2c_inst_t * i2c) {
-    if (i2c == i2c0) {
-        numDevicesOnBus[0] = 0;
-    }
-    else if (i2c == i2c1) {
-        numDevicesOnBus[1] = 0;
+    i2c_bus_t *             bus = i2cGetBus(i2c);
+
+    memset(bus->addressIndex, I2C_NO_DEVICE, sizeof(bus->addressIndex));
+
+    bus->maxDevices = 0;
+    bus->numDevices = 0;
+
+    return 0;
+}
+
+int i2c_bus_register_device(
+            i2c_inst_t * i2c, 
+            const uint address, 
+            uint maxBaudrate, 
+            int (* setup)(i2c_inst_t *), 
+            int (* probe)(i2c_inst_t *))
+{
+    i2c_bus_t *             bus = i2cGetBus(i2c);
+    i2c_device_t *          device;
+
+    if (address >= I2C_ADDRESS_COUNT) {
+        return PICO_ERROR_INVALID_ARG;
     }
-    else {
-        return -1;
+
+    if (bus->numDevices >= bus->maxDevices || bus->addressIndex[address] != I2C_NO_DEVICE) {
+        return PICO_ERROR_GENERIC;
     }
 
+    device = &bus->devices[bus->numDevices];
+
+    device->address = address;
+    device->isActive = true;
+    device->lastStateTime = 0;
+    device->backoff = 0;
+    device->consecutiveErrors = 0;
+    device->maxBaudrate = maxBaudrate;
+    device->setup = setup;
+    device->probe = probe;
+
+    bus->addressIndex[address] = (uint8_t)bus->numDevices;
+    bus->numDevices++;
+
     return 0;
 }
 
-int i2c_bus_register_device(i2c_inst_t * i2c, const uint address, int (* setup)(i2c_inst_t *)) {
-    static int              busIndex0 = 0;
-    static int              busIndex1 = 0;
-    int *                   busIndex;
-    int                     numDevices;
-    i2c_device_t *          devices;
+/*
+** Does the device answer reliably at the current speed? One without a 
+** probe function is assumed to work at any speed up to its maximum...
+*/
+static bool i2cProbeDevice(i2c_inst_t * i2c, i2c_device_t * device) {
+    int                     i;
 
-    if (i2c == i2c0) {
-        devices = devices_i2c0;
-        busIndex = &busIndex0;
-        numDevices = numDevicesOnBus[0];
+    if (device->probe == NULL) {
+        return true;
     }
-    else if (i2c == i2c1) {
-        devices = devices_i2c1;
-        busIndex = &busIndex1;
-        numDevices = numDevicesOnBus[1];
+
+    for (i = 0;i < I2C_PROBE_ATTEMPTS;i++) {
+        if (device->probe(i2c) != 0) {
+            return false;
+        }
     }
-    else {
-        return -1;
+
+    return true;
+}
+
+/*
+** Try each speed the devices & clock allow. A device that fails at 
+** every speed is taken to be missing, so it doesn't hold the rest of 
+** the bus back. We run at the fastest speed all the others pass at...
+*/
+static uint i2cNegotiateSpeed(i2c_inst_t * i2c) {
+    i2c_bus_t *             bus = i2cGetBus(i2c);
+    uint                    maxBaudrate = UINT32_MAX;
+    uint16_t                okMask[I2C_NUM_SPEEDS];
+    uint16_t                presentMask = 0;
+    int                     i;
+    int                     s;
+
+    for (i = 0;i < bus->numDevices;i++) {
+        if (bus->devices[i].maxBaudrate && bus->devices[i].maxBaudrate < maxBaudrate) {
+            maxBaudrate = bus->devices[i].maxBaudrate;
+        }
     }
 
-    if (*busIndex >= numDevices) {
-        return PICO_ERROR_GENERIC;
+    bus->isNegotiating = true;
+
+    for (s = 0;s < I2C_NUM_SPEEDS;s++) {
+        okMask[s] = 0;
+
+        /*
+        ** The clock drops to CLOCK_PERF_LOW whenever nothing needs 
+        ** more, so the bus must work at that...
+        */
+        if (speeds[s].baudrate > maxBaudrate || speeds[s].minSysKHz > CLOCK_PERF_LOW_KHZ) {
+            continue;
+        }
+
+        clockI2CSetBaudrate(i2c, speeds[s].baudrate);
+
+        for (i = 0;i < bus->numDevices;i++) {
+            if (i2cProbeDevice(i2c, &bus->devices[i])) {
+                okMask[s] |= (1 << i);
+            }
+        }
+
+        presentMask |= okMask[s];
     }
 
-    devices[*busIndex].address = address;
-    devices[*busIndex].isActive = true;
-    devices[*busIndex].lastStateTime = 0;
-    devices[*busIndex].setup = setup;
+    bus->isNegotiating = false;
 
-    (*busIndex)++;
+    if (presentMask == 0) {
+        lgLogError("No I2C devices responded, trying again next time");
+        return 0;
+    }
 
-    return 0;
+    for (s = 0;s < I2C_NUM_SPEEDS;s++) {
+        if (okMask[s] == presentMask) {
+            break;
+        }
+    }
+
+    /*
+    ** No single speed suits them all, fall back to the slowest...
+    */
+    if (s == I2C_NUM_SPEEDS) {
+        s = I2C_NUM_SPEEDS - 1;
+    }
+
+    lgLogInfo("I2C%d running at %u Hz", i2c_get_index(i2c), speeds[s].baudrate);
+
+    return speeds[s].baudrate;
 }
 
+/*
+** Set up all the devices, the first time round we work out how fast 
+** the bus can go...
+*/
 int i2c_bus_setup(i2c_inst_t * i2c) {
-    i2c_device_t *          devices;
+    i2c_bus_t *             bus = i2cGetBus(i2c);
     int                     i;
     int                     error = 0;
-    int                     numDevices;
 
-    if (i2c == i2c0) {
-        devices = devices_i2c0;
-        numDevices = numDevicesOnBus[0];
+    if (bus->baudrate == 0) {
+        bus->baudrate = i2cNegotiateSpeed(i2c);
     }
-    else if (i2c == i2c1) {
-        devices = devices_i2c1;
-        numDevices = numDevicesOnBus[1];
-    }
-    else {
-        return -1;
+
+    if (bus->baudrate) {
+        clockI2CSetBaudrate(i2c, bus->baudrate);
     }
 
-    for (i = 0;i < numDevices;i++) {
-        error |= devices[i].setup(i2c);
+    for (i = 0;i < bus->numDevices;i++) {
+        error |= bus->devices[i].setup(i2c);
     }
 
     return error;
 }
 
-int i2cReadTimeoutProtected(
-                i2c_inst_t * i2c, 
-                const uint address, 
-                uint8_t * dst, 
-                size_t len, 
-                bool nostop)
-{
-    int             error;
-    i2c_device_t *  device;
+/*
+** Tidy up after an abort (e.g. the address was NACKed) or a timeout. The
+** controller always finishes with a STOP...
+*/
+static void i2cEndAbort(i2c_hw_t * hw, bool isTimeout) {
+    uint64_t            deadline;
+
+    deadline = time_us_64() + I2C_TIMEOUT_US;
 
-    if (i2cGetDeviceState(i2c, address)) {
-        error = i2c_read_timeout_us(i2c, address, dst, len, nostop, I2C_TIMEOUT_US);
+    if (isTimeout) {
+        hw->enable |= I2C_IC_ENABLE_ABORT_BITS;
 
-        if (error == PICO_ERROR_GENERIC) {
-            i2cSetDeviceState(i2c, address, false);
+        while (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) && time_us_64() < deadline) {
+            tight_loop_contents();
         }
     }
-    else {
-        device = i2cGetDeviceByAddress(i2c, address);
 
-        if (getRTCClock() > (device->lastStateTime + rtc_val_sec(5))) {
-            error = i2c_read_timeout_us(i2c, address, dst, len, nostop, I2C_TIMEOUT_US);
+    (void)hw->clr_tx_abrt;
+
+    while (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS) && time_us_64() < deadline) {
+        tight_loop_contents();
+    }
+
+    (void)hw->clr_stop_det;
+}
+
+/*
+** Step through a list of segments a byte at a time...
+*/
+static uint8_t * i2cNextByte(const i2c_segment_t * segments, int count, int * seg, size_t * index) {
+    while (*seg < count && *index >= segments[*seg].length) {
+        (*seg)++;
+        *index = 0;
+    }
+
+    if (*seg >= count) {
+        return NULL;
+    }
+
+    return &segments[*seg].data[(*index)++];
+}
+
+static void i2cDrainRx(i2c_inst_t * i2c, i2c_xfer_t * xfer) {
+    i2c_hw_t *          hw = i2c_get_hw(i2c);
+    uint8_t *           dst;
 
-            if (error == PICO_ERROR_GENERIC) {
-                /*
-                ** This will reset the clock so we don't 
-                ** immediately try again
-                */
-                i2cSetDeviceState(i2c, address, false);
+    while (xfer->rxReceived < xfer->rxTotal && i2c_get_read_available(i2c) > 0) {
+        dst = i2cNextByte(xfer->rx, xfer->rxCount, &xfer->rxSeg, &xfer->rxIndex);
+        *dst = (uint8_t)hw->data_cmd;
+        xfer->rxReceived++;
+    }
+}
+
+/*
+** Keep the command FIFO topped up: the tx bytes, then a read command 
+** for each rx byte with a repeated START on the first & a STOP on the
+** last. We never have more reads outstanding than the rx FIFO holds...
+*/
+static void i2cQueueCommands(i2c_inst_t * i2c, i2c_xfer_t * xfer) {
+    i2c_hw_t *          hw = i2c_get_hw(i2c);
+    size_t              total = xfer->txTotal + xfer->rxTotal;
+    uint32_t            cmd;
+
+    while (xfer->cmdCount < total && i2c_get_write_available(i2c) > 0) {
+        if (xfer->cmdCount < xfer->txTotal) {
+            cmd = *i2cNextByte(xfer->tx, xfer->txCount, &xfer->cmdSeg, &xfer->cmdIndex);
+        }
+        else {
+            if ((xfer->cmdCount - xfer->txTotal - xfer->rxReceived) >= I2C_FIFO_DEPTH) {
+                break;
             }
-            else {
-                i2cSetDeviceState(i2c, address, true);
+
+            cmd = I2C_IC_DATA_CMD_CMD_BITS;
+
+            if (xfer->cmdCount == xfer->txTotal && xfer->txTotal > 0) {
+                cmd |= I2C_IC_DATA_CMD_RESTART_BITS;
             }
         }
-        else {
-            error = PICO_ERROR_GENERIC;
+
+        if ((xfer->cmdCount + 1) == total) {
+            cmd |= I2C_IC_DATA_CMD_STOP_BITS;
         }
+
+        hw->data_cmd = cmd;
+        xfer->cmdCount++;
     }
 
-    return error;
+    if (xfer->cmdCount == total) {
+        hw->intr_mask &= ~I2C_IC_INTR_MASK_M_TX_EMPTY_BITS;
+    }
 }
 
-int i2cWriteTimeoutProtected(
+/*
+** The transfer runs from the controller's interrupt, so both buses can
+** be busy at once while the task carries on. It ends on the STOP, which
+** the controller also sends after an abort...
+*/
+static void i2cHandleIRQ(i2c_inst_t * i2c) {
+    i2c_hw_t *          hw = i2c_get_hw(i2c);
+    i2c_xfer_t *        xfer = &i2cGetBus(i2c)->xfer;
+    uint32_t            status;
+
+    status = hw->intr_stat;
+
+    if (status & I2C_IC_INTR_MASK_M_TX_ABRT_BITS) {
+        xfer->isAborted = true;
+
+        (void)hw->clr_tx_abrt;
+        hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS;
+    }
+
+    if (!xfer->isAborted) {
+        i2cDrainRx(i2c, xfer);
+        i2cQueueCommands(i2c, xfer);
+    }
+
+    if (status & I2C_IC_INTR_MASK_M_STOP_DET_BITS) {
+        (void)hw->clr_stop_det;
+
+        i2cDrainRx(i2c, xfer);
+
+        hw->intr_mask = 0;
+        xfer->isBusy = false;
+    }
+}
+
+static void i2c0IRQ(void) {
+    i2cHandleIRQ(i2c0);
+}
+
+static void i2c1IRQ(void) {
+    i2cHandleIRQ(i2c1);
+}
+
+/*
+** Start one complete transaction: START, the tx segments back to back,
+** then a repeated START & the rx segments, then STOP. Either side may
+** be empty. The segments & their buffers must stay put until the 
+** transfer is finished...
+*/
+static int i2cXferStart(
                 i2c_inst_t * i2c, 
                 const uint address, 
-                uint8_t * src, 
-                size_t len, 
-                bool nostop)
+                const i2c_segment_t * tx, 
+                int txCount, 
+                const i2c_segment_t * rx, 
+                int rxCount)
 {
-    int             error;
-    i2c_device_t *  device;
+    i2c_bus_t *         bus = i2cGetBus(i2c);
+    i2c_xfer_t *        xfer = &bus->xfer;
+    i2c_hw_t *          hw = i2c_get_hw(i2c);
+    int                 seg;
 
-    if (i2cGetDeviceState(i2c, address)) {
-        error = i2c_write_timeout_us(i2c, address, src, len, nostop, I2C_TIMEOUT_US);
+    memset(xfer, 0, sizeof(i2c_xfer_t));
 
-        switch (error) {
-            case PICO_ERROR_GENERIC:
-                lgLogError("Generic I2C error writing to addr: 0x%02X", address);
-                i2cSetDeviceState(i2c, address, false);
-                break;
+    for (seg = 0;seg < txCount;seg++) {
+        xfer->txTotal += tx[seg].length;
+    }
+    for (seg = 0;seg < rxCount;seg++) {
+        xfer->rxTotal += rx[seg].length;
+    }
 
-            case PICO_ERROR_TIMEOUT:
-                lgLogError("I2C timeout writing to addr: 0x%02X", address);
-                break;
+    if ((xfer->txTotal + xfer->rxTotal) == 0) {
+        return PICO_ERROR_INVALID_ARG;
+    }
 
-            default:
-                lgLogDebug("Written %d bytes to addr: 0x%02X", error, address);
-                break;
-        }
+    if (!bus->isIRQInstalled) {
+        irq_set_exclusive_handler((i2c_get_index(i2c) ? I2C1_IRQ : I2C0_IRQ), (i2c_get_index(i2c) ? i2c1IRQ : i2c0IRQ));
+        irq_set_enabled((i2c_get_index(i2c) ? I2C1_IRQ : I2C0_IRQ), true);
+
+        bus->isIRQInstalled = true;
     }
-    else {
-        device = i2cGetDeviceByAddress(i2c, address);
-
-        if (getRTCClock() > (device->lastStateTime + rtc_val_sec(5))) {
-            error = i2c_write_timeout_us(i2c, address, src, len, nostop, I2C_TIMEOUT_US);
-
-            switch (error) {
-                case PICO_ERROR_GENERIC:
-                    lgLogError("Generic I2C error writing to addr: 0x%02X", address);
-                    /*
-                    ** This will reset the clock so we don't 
-                    ** immediately try again
-                    */
-                    i2cSetDeviceState(i2c, address, false);
-                    break;
-
-                case PICO_ERROR_TIMEOUT:
-                    lgLogError("I2C timeout writing to addr: 0x%02X", address);
-                    i2cSetDeviceState(i2c, address, true);
-                    break;
-
-                default:
-                    lgLogDebug("Written %d bytes to addr: 0x%02X", error, address);
-                    i2cSetDeviceState(i2c, address, true);
-                    break;
-            }
-        }
-        else {
-            error = PICO_ERROR_GENERIC;
+
+    xfer->tx = tx;
+    xfer->txCount = txCount;
+    xfer->rx = rx;
+    xfer->rxCount = rxCount;
+    xfer->address = address;
+    xfer->deadline = 
+            time_us_64() + 
+            I2C_TIMEOUT_US + 
+            ((xfer->txTotal + xfer->rxTotal) * I2C_TIMEOUT_PER_BYTE_US);
+
+    hw->intr_mask = 0;
+    hw->enable = 0;
+    hw->tar = address;
+    hw->enable = 1;
+
+    (void)hw->clr_intr;
+
+    xfer->isBusy = true;
+    bus->isPending = true;
+
+    /*
+    ** The tx FIFO is empty, so this interrupts straight away & the 
+    ** handler starts queueing commands...
+    */
+    hw->intr_mask = 
+            I2C_IC_INTR_MASK_M_TX_EMPTY_BITS | 
+            I2C_IC_INTR_MASK_M_RX_FULL_BITS | 
+            I2C_IC_INTR_MASK_M_TX_ABRT_BITS | 
+            I2C_IC_INTR_MASK_M_STOP_DET_BITS;
+
+    return 0;
+}
+
+/*
+** Wait for the transfer to finish, returns the number of bytes read, 
+** or written if there was nothing to read...
+*/
+static int i2cXferWait(i2c_inst_t * i2c) {
+    i2c_xfer_t *        xfer = &i2cGetBus(i2c)->xfer;
+    i2c_hw_t *          hw = i2c_get_hw(i2c);
+
+    while (xfer->isBusy) {
+        if (time_us_64() > xfer->deadline) {
+            hw->intr_mask = 0;
+            xfer->isBusy = false;
+
+            i2cEndAbort(hw, true);
+
+            return PICO_ERROR_TIMEOUT;
         }
+
+        tight_loop_contents();
     }
 
-    return error;
+    if (xfer->isAborted || 
+        xfer->cmdCount < (xfer->txTotal + xfer->rxTotal) || 
+        xfer->rxReceived < xfer->rxTotal)
+    {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return (int)(xfer->rxTotal > 0 ? xfer->rxTotal : xfer->txTotal);
 }
 
-int i2cWriteRegister(
-            i2c_inst_t *i2c, 
-            const uint addr, 
-            const uint8_t reg, 
-            uint8_t * data, 
-            const uint8_t length)
+static i2c_device_t * i2cGetTrackedDevice(i2c_inst_t * i2c, uint address) {
+    /*
+    ** Failures while working out the bus speed are expected, don't 
+    ** count them against the device...
+    */
+    return (i2cGetBus(i2c)->isNegotiating ? NULL : i2cGetDeviceByAddress(i2c, address));
+}
+
+/*
+** Start a transfer unless the device is backing off...
+*/
+static int i2cBegin(
+                i2c_inst_t * i2c, 
+                const uint address, 
+                const i2c_segment_t * tx, 
+                int txCount, 
+                const i2c_segment_t * rx, 
+                int rxCount)
 {
-    int             bytesWritten = 0;
-    uint8_t         msg[length + 1];
+    i2c_device_t *  device;
+
+    device = i2cGetTrackedDevice(i2c, address);
+
+    if (device != NULL && i2cIsBackingOff(device)) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return i2cXferStart(i2c, address, tx, txCount, rx, rxCount);
+}
 
-    msg[0] = reg;
-    memcpy(&msg[1], data, length);
+/*
+** Wait for the transfer in progress & pass the result through the 
+** device's backoff & error tracking, recovering the bus if a device has
+** been left holding SDA low...
+*/
+static int i2cFinish(i2c_inst_t * i2c) {
+    i2c_bus_t *     bus = i2cGetBus(i2c);
+    uint            address = bus->xfer.address;
+    int             error;
+    i2c_device_t *  device;
 
-    bytesWritten = i2c_write_timeout_us(i2c, addr, msg, (length + 1), false, I2C_TIMEOUT_US);
+    error = i2cXferWait(i2c);
 
-    switch (bytesWritten) {
+    bus->isPending = false;
+
+    switch (error) {
         case PICO_ERROR_GENERIC:
-            lgLogError("Generic I2C error writing to addr: 0x%02X", addr);
+            lgLogError("Generic I2C error with addr: 0x%02X", address);
             break;
 
         case PICO_ERROR_TIMEOUT:
-            lgLogError("I2C timeout writing to addr: 0x%02X", addr);
+            lgLogError("I2C timeout with addr: 0x%02X", address);
             break;
 
         default:
-            lgLogDebug("Written %d bytes to addr: 0x%02X", bytesWritten, addr);
+            lgLogDebug("Transferred %d bytes with addr: 0x%02X", error, address);
             break;
     }
 
-    return bytesWritten;
+    device = i2cGetTrackedDevice(i2c, address);
+
+    if (error < 0) {
+        if (device != NULL) {
+            i2cRecordError(device);
+        }
+
+        if (!gpio_get(bus->pins.sda)) {
+            i2cBusRecover(i2c);
+        }
+    }
+    else if (device != NULL) {
+        i2cRecordSuccess(device);
+    }
+
+    return error;
 }
 
-int i2cReadRegister(
-            i2c_inst_t *i2c, 
-            const uint addr, 
-            const uint8_t reg, 
-            uint8_t * data, 
-            const uint8_t length)
-{
-    int     bytesRead = 0;
-    int     error = 0;
-    uint8_t regid = reg;
+/*
+** A bus runs one transfer at a time, so finish any started with 
+** i2cTransactionStart() first, keeping its result for 
+** i2cTransactionWait()...
+*/
+static void i2cFinishPending(i2c_inst_t * i2c) {
+    i2c_bus_t *     bus = i2cGetBus(i2c);
 
-    // Read data from register(s) over I2C
-    error = i2c_write_timeout_us(i2c, addr, &regid, 1, true, I2C_TIMEOUT_US);
+    if (bus->isPending) {
+        bus->asyncResult = i2cFinish(i2c);
+    }
+}
 
-    switch (error) {
-        case PICO_ERROR_GENERIC:
-            lgLogError("Generic I2C error writing to addr: 0x%02X", addr);
-            break;
+/*
+** Run a transaction & wait for it...
+*/
+int i2cTransaction(
+                i2c_inst_t * i2c, 
+                const uint address, 
+                const i2c_segment_t * tx, 
+                int txCount, 
+                const i2c_segment_t * rx, 
+                int rxCount)
+{
+    int             error;
 
-        case PICO_ERROR_TIMEOUT:
-            lgLogError("I2C timeout writing to addr: 0x%02X", addr);
-            break;
+    i2cFinishPending(i2c);
 
-        default:
-            lgLogDebug("Written %d bytes to addr: 0x%02X", error, addr);
-            break;
+    error = i2cBegin(i2c, address, tx, txCount, rx, rxCount);
+
+    if (error < 0) {
+        return error;
     }
 
-    bytesRead = i2cReadTimeoutProtected(i2c, addr, data, length, false);
+    return i2cFinish(i2c);
+}
 
-    switch (bytesRead) {
-        case PICO_ERROR_GENERIC:
-            lgLogError("Generic I2C error reading from addr: 0x%02X", addr);
-            break;
+/*
+** Start a transaction & return straight away, so the task can get on 
+** with a transaction on the other bus. Collect the result with 
+** i2cTransactionWait(), only one can be outstanding per bus. The 
+** segments & buffers must stay put until then...
+*/
+int i2cTransactionStart(
+                i2c_inst_t * i2c, 
+                const uint address, 
+                const i2c_segment_t * tx, 
+                int txCount, 
+                const i2c_segment_t * rx, 
+                int rxCount)
+{
+    i2c_bus_t *     bus = i2cGetBus(i2c);
+    int             error;
 
-        case PICO_ERROR_TIMEOUT:
-            lgLogError("I2C timeout reading from addr: 0x%02X", addr);
-            break;
+    i2cFinishPending(i2c);
 
-        default:
-            lgLogDebug("Read %d bytes from addr: 0x%02X", bytesRead, addr);
-            break;
+    error = i2cBegin(i2c, address, tx, txCount, rx, rxCount);
+
+    bus->asyncResult = error;
+    bus->isAsync = true;
+
+    return (error < 0 ? error : 0);
+}
+
+int i2cTransactionWait(i2c_inst_t * i2c) {
+    i2c_bus_t *     bus = i2cGetBus(i2c);
+
+    if (!bus->isAsync) {
+        return PICO_ERROR_INVALID_ARG;
     }
 
-    return bytesRead;
+    i2cFinishPending(i2c);
+
+    bus->isAsync = false;
+
+    return bus->asyncResult;
+}
+
+int i2cReadTimeoutProtected(
+                i2c_inst_t * i2c, 
+                const uint address, 
+                uint8_t * dst, 
+                size_t len)
+{
+    i2c_segment_t   rx = {dst, len};
+
+    return i2cTransaction(i2c, address, NULL, 0, &rx, 1);
+}
+
+int i2cWriteTimeoutProtected(
+                i2c_inst_t * i2c, 
+                const uint address, 
+                uint8_t * src, 
+                size_t len)
+{
+    i2c_segment_t   tx = {src, len};
+
+    return i2cTransaction(i2c, address, &tx, 1, NULL, 0);
+}
+
+/*
+** Write a command then read the response after a repeated START...
+*/
+int i2cWriteRead(
+                i2c_inst_t * i2c, 
+                const uint address, 
+                uint8_t * src, 
+                size_t txLen, 
+                uint8_t * dst, 
+                size_t rxLen)
+{
+    i2c_segment_t   tx = {src, txLen};
+    i2c_segment_t   rx = {dst, rxLen};
+
+    return i2cTransaction(i2c, address, &tx, 1, &rx, 1);
+}
+
+int i2cWriteRegister(
+            i2c_inst_t *i2c, 
+            const uint addr, 
+            const uint8_t reg, 
+            uint8_t * data, 
+            const uint8_t length)
+{
+    uint8_t         regid = reg;
+    i2c_segment_t   tx[2] = {{&regid, 1}, {data, length}};
+
+    return i2cTransaction(i2c, addr, tx, 2, NULL, 0);
+}
+
+/*
+** Read length bytes starting at reg, devices that auto-increment the
+** register pointer (e.g. the MAX17048) can burst read several 
+** registers at once...
+*/
+int i2cReadRegister(
+            i2c_inst_t *i2c, 
+            const uint addr, 
+            const uint8_t reg, 
+            uint8_t * data, 
+            const uint8_t length)
+{
+    uint8_t         regid = reg;
+
+    return i2cWriteRead(i2c, addr, &regid, 1, data, length);
 }
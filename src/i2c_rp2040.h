@@ -9,39 +9,103 @@
 
 #define I2C_SDA_HOLD                38
 
+#define I2C_BAUDRATE_STANDARD       100000
+#define I2C_BAUDRATE_FAST           400000
+#define I2C_BAUDRATE_FAST_PLUS     1000000
+#define I2C_NUM_SPEEDS              3
+
+/*
+** A device that fails is left alone for I2C_BACKOFF_MIN, doubling 
+** with each consecutive failure up to I2C_BACKOFF_MAX...
+*/
+#define I2C_BACKOFF_MIN             rtc_val_sec(5)
+#define I2C_BACKOFF_MAX             rtc_val_min(60)
+
+/*
+** Bus health byte:
+**
+** 0 - 3        Device 0 - 3 (in order registered) failed its last access
+** 4 - 7        Bus recoveries since the health was last read (max 15)
+*/
+#define I2C_HEALTH_DEVICE_MASK      0x0F
+#define I2C_HEALTH_RECOVERY_SHIFT   4
+#define I2C_HEALTH_RECOVERY_MAX     15
+
 typedef struct {
     uint                    address;
 
     rtc_t                   lastStateTime;
+    rtc_t                   backoff;
     bool                    isActive;
 
+    uint8_t                 consecutiveErrors;
+
+    /*
+    ** The fastest the device can go, 0 for no limit...
+    */
+    uint                    maxBaudrate;
+
     int (* setup)(i2c_inst_t *);
+    int (* probe)(i2c_inst_t *);
 }
 i2c_device_t;
 
+/*
+** One buffer of a scatter/gather transaction...
+*/
+typedef struct {
+    uint8_t *               data;
+    size_t                  length;
+}
+i2c_segment_t;
+
 void i2cBusPowerUp(void);
 void i2cBusPowerDown(void);
 
 bool    i2cGetDeviceState(i2c_inst_t * i2c, uint address);
-int     i2c_bus_open(i2c_inst_t * i2c, int numDevices);
+uint8_t i2cGetBusHealth(i2c_inst_t * i2c);
+bool    i2cBusRecover(i2c_inst_t * i2c);
+int     i2c_bus_open(i2c_inst_t * i2c, int maxDevices);
 int     i2c_bus_close(i2c_inst_t * i2c);
 int     i2c_bus_register_device(
             i2c_inst_t * i2c, 
             uint address, 
-            int (* setup)(i2c_inst_t *));
+            uint maxBaudrate, 
+            int (* setup)(i2c_inst_t *), 
+            int (* probe)(i2c_inst_t *));
 int     i2c_bus_setup(i2c_inst_t * i2c);
+int     i2cTransaction(
+            i2c_inst_t * i2c, 
+            const uint address, 
+            const i2c_segment_t * tx, 
+            int txCount, 
+            const i2c_segment_t * rx, 
+            int rxCount);
+int     i2cTransactionStart(
+            i2c_inst_t * i2c, 
+            const uint address, 
+            const i2c_segment_t * tx, 
+            int txCount, 
+            const i2c_segment_t * rx, 
+            int rxCount);
+int     i2cTransactionWait(i2c_inst_t * i2c);
 int     i2cReadTimeoutProtected(
             i2c_inst_t * i2c, 
             const uint address, 
             uint8_t * dst, 
-            size_t len, 
-            bool nostop);
+            size_t len);
 int     i2cWriteTimeoutProtected(
             i2c_inst_t * i2c, 
             const uint address, 
             uint8_t * src, 
-            size_t len, 
-            bool nostop);
+            size_t len);
+int     i2cWriteRead(
+            i2c_inst_t * i2c, 
+            const uint address, 
+            uint8_t * src, 
+            size_t txLen, 
+            uint8_t * dst, 
+            size_t rxLen);
 int     i2cWriteRegister(
             i2c_inst_t *i2c, 
             const uint addr, 
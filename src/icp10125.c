@@ -1,35 +1,109 @@
 #include <stdint.h>
+#include <stdbool.h>
 
+#ifndef UNIT_TEST_MODE
 #include "hardware/i2c.h"
 #include "i2c_rp2040.h"
 #include "utils.h"
 #include "logger.h"
+#endif
+
 #include "icp10125.h"
 
-uint16_t            otpValues[4];
-float               sensor_constants[4];
+/*
+** The pressure conversion is done in fixed point, the M0+ has no FPU and
+** the float version costs a dozen soft-float multiplies & divides per
+** reading. The three calibration pressures (45000, 80000 & 105000 Pa) are
+** all multiples of 5000 Pa, so the 5000 is factored out...
+*/
+#define ICP_P_CALIB_UNIT                    5000LL
+#define ICP_P_CALIB_0                       9LL             // 45000 Pa
+#define ICP_P_CALIB_1                       16LL            // 80000 Pa
+#define ICP_P_CALIB_2                       21LL            // 105000 Pa
 
-const float p_Pa_calib[3] = {45000.0f, 80000.0f, 105000.0f};
-const float LUT_lower = 3670016.0f;
-const float LUT_upper = 12058624.0f;
-const float quadr_factor = 0.000000059605f;
-const float offst_factor = 2048.0;
+#define ICP_LUT_LOWER                       3670016LL
+#define ICP_LUT_UPPER                       12058624LL
+#define ICP_OFFSET_FACTOR                   2048LL
 
-static void calculate_conversion_constants(const float *p_Pa, const float *p_LUT, float *out) { 
-    float A, B, C; 
-    
-    C = (p_LUT[0] * p_LUT[1] * (p_Pa[0] - p_Pa[1]) + 
-    p_LUT[1] * p_LUT[2] * (p_Pa[1] - p_Pa[2]) + 
-    p_LUT[2] * p_LUT[0] * (p_Pa[2] - p_Pa[0])) / 
-    (p_LUT[2] * (p_Pa[0] - p_Pa[1]) + 
-    p_LUT[0] * (p_Pa[1] - p_Pa[2]) + 
-    p_LUT[1] * (p_Pa[2] - p_Pa[0])); 
-    A = (p_Pa[0] * p_LUT[0] - p_Pa[1] * p_LUT[1] - (p_Pa[1] - p_Pa[0]) * C) / (p_LUT[0] - p_LUT[1]); 
-    B = (p_Pa[0] - A) * (p_LUT[0] + C); 
-    
-    out[0] = A; 
-    out[1] = B; 
-    out[2] = C; 
+/*
+** The quadratic factor 0.000000059605 as 59605 / 10^12...
+*/
+#define ICP_QUADR_FACTOR_NUM                59605ULL
+#define ICP_QUADR_FACTOR_DEN                1000000000000ULL
+
+/*
+** Fraction bits carried by the LUT values & by the pressure before it 
+** is truncated to whole Pa...
+*/
+#define ICP_LUT_FRACTION_BITS               3
+#define ICP_P_FRACTION_BITS                 12
+
+/*
+** The remainder of the final division is scaled by 5000 * 2^12 (< 2^25),
+** so the divisor is cut down to this many bits first...
+*/
+#define ICP_DIVISOR_MAX_BITS                36
+
+static uint16_t             otpValues[4];
+static bool                 isOTPCached = false;
+
+/*
+** Divide, rounding to the nearest...
+*/
+static int64_t _divRound(int64_t n, int64_t d) {
+    if (d < 0) {
+        n = -n;
+        d = -d;
+    }
+
+    if (n < 0) {
+        return -((-n + (d >> 1)) / d);
+    }
+    else {
+        return (n + (d >> 1)) / d;
+    }
+}
+
+/*
+** The LUT value for one of the calibration points, e.g. 
+** offset + c * t^2 * 0.000000059605 with ICP_LUT_FRACTION_BITS. The 
+** product is at most 65535 * 2^30 * 59605 < 2^62 so can't overflow, 
+** and 10^12 is divisible by 2^12 so the scaling is exact...
+*/
+static int64_t _lutValue(int64_t offset, uint16_t c, uint32_t t2) {
+    uint64_t        q;
+    uint64_t        d;
+
+    q = (uint64_t)c * (uint64_t)t2 * ICP_QUADR_FACTOR_NUM;
+    d = ICP_QUADR_FACTOR_DEN >> ICP_LUT_FRACTION_BITS;
+
+    return (offset << ICP_LUT_FRACTION_BITS) + (int64_t)((q + (d >> 1)) / d);
+}
+
+#ifndef UNIT_TEST_MODE
+static bool                 isChipIDValid = false;
+
+/*
+** Read the chip ID, the low 6 bits are always 0x08...
+*/
+int icp10125_probe(i2c_inst_t * i2c) {
+    int                 error;
+    uint8_t             buffer[3];
+
+    buffer[0] = 0xEF;
+    buffer[1] = 0xC8;
+
+    error = i2cWriteRead(i2c, ICP10125_ADDRESS, buffer, 2, buffer, 3);
+
+    if (error < 0) {
+        return error;
+    }
+
+    if ((copyI2CReg_uint16(buffer) & 0x3F) != 0x08) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return 0;
 }
 
 int icp10125_setup(i2c_inst_t * i2c) {
@@ -37,16 +111,25 @@ int icp10125_setup(i2c_inst_t * i2c) {
     uint8_t             buffer[8];
     uint16_t            chipID;
 
+    /*
+    ** The I2C rail is powered down between cycles, so once we've seen 
+    ** the right chip ID and have the OTP calibration, the power-on reset 
+    ** leaves the sensor ready to measure with nothing to set up...
+    */
+    if (isChipIDValid && isOTPCached) {
+        return 0;
+    }
+
     /*
     ** Issue soft reset...
     */
     buffer[0] = 0x80;
     buffer[1] = 0x5D;
 
-    error = i2cWriteTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 2, false);
+    error = i2cWriteTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 2);
 
-    if (error == PICO_ERROR_TIMEOUT) {
-        return PICO_ERROR_TIMEOUT;
+    if (error < 0) {
+        return error;
     }
 
     sleep_ms(10U);
@@ -57,11 +140,14 @@ int icp10125_setup(i2c_inst_t * i2c) {
     buffer[0] = 0xEF;
     buffer[1] = 0xC8;
 
-    i2cWriteTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 2, true);
-    error = i2cReadTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 3, false);
+    error = i2cWriteRead(i2c, ICP10125_ADDRESS, buffer, 2, buffer, 3);
 
-    if (error == PICO_ERROR_TIMEOUT) {
-        return PICO_ERROR_TIMEOUT;
+    /*
+    ** On a NAK the buffer still holds the command, which would pass the
+    ** chip ID check...
+    */
+    if (error < 0) {
+        return error;
     }
     
     chipID = copyI2CReg_uint16(buffer);
@@ -71,6 +157,19 @@ int icp10125_setup(i2c_inst_t * i2c) {
         return -1;
     }
 
+    isChipIDValid = true;
+
+    /*
+    ** The OTP calibration never changes, so only read it once...
+    */
+    if (!isOTPCached) {
+        error = icp10125_read_otp(i2c);
+
+        if (error < 0) {
+            return error;
+        }
+    }
+
     return 0;
 }
 
@@ -85,35 +184,161 @@ int icp10125_read_otp(i2c_inst_t * i2c) {
     buffer[3] = 0x66;
     buffer[4] = 0x9C;
 
-    error = i2cWriteTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 5, false);
+    error = i2cWriteTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 5);
 
-    if (error == PICO_ERROR_TIMEOUT) {
-        return PICO_ERROR_TIMEOUT;
+    if (error < 0) {
+        return error;
     }
     
     for (i = 0; i < 4; i++) {
         buffer[0] = 0xC7;
         buffer[1] = 0xF7;
 
-        i2cWriteTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 2, false);
-        i2cReadTimeoutProtected(i2c, ICP10125_ADDRESS, buffer, 3, false);
+        error = i2cWriteRead(i2c, ICP10125_ADDRESS, buffer, 2, buffer, 3);
+
+        if (error < 0) {
+            return error;
+        }
 
         otpValues[i] = (uint16_t)((uint16_t)buffer[0] << 8 | (uint16_t)buffer[1]);
     }
 
-    for(i = 0; i < 4; i++) {
-        sensor_constants[i] = (float)otpValues[i];
+    isOTPCached = true;
+
+    return 0;
+}
+#else
+void icp10125_set_otp(const uint16_t * otp) {
+    int                 i;
+
+    for (i = 0; i < 4; i++) {
+        otpValues[i] = otp[i];
+    }
+
+    isOTPCached = true;
+}
+#endif
+
+int icp10125_process_data(const int p_LSB, const int T_LSB, int * pressure) { 
+    int32_t             t;
+    uint32_t            t2;
+    int64_t             s0, s1, s2;
+    int64_t             x;
+    int64_t             Kn, Kd;
+    int64_t             num, den;
+    int64_t             q, r;
+
+    t = (int32_t)T_LSB - 32768;
+    t2 = (uint32_t)(t * t);
+
+    s0 = _lutValue(ICP_LUT_LOWER, otpValues[0], t2);
+    s1 = _lutValue(ICP_OFFSET_FACTOR * (int64_t)otpValues[3], otpValues[1], t2);
+    s2 = _lutValue(ICP_LUT_UPPER, otpValues[2], t2);
+
+    /*
+    ** The LUT values must increase with the calibration pressure, this
+    ** also bounds s1 by s2 (< 2^27 with the fraction bits)...
+    */
+    if (s0 >= s1 || s1 >= s2) {
+        return -1;
+    }
+
+    x = (int64_t)p_LSB << ICP_LUT_FRACTION_BITS;
+
+    /*
+    ** The float version solves for the A, B & C of P = A + B / (C + x)
+    ** through the three calibration points. C blows up as the sensor 
+    ** response gets close to linear, so instead we use the fact that the
+    ** curve preserves the cross ratio of the calibration points:
+    **
+    ** (P - P0)(P1 - P2)     (x - s0)(s1 - s2)     Kn
+    ** -----------------  =  -----------------  =  --
+    ** (P - P2)(P1 - P0)     (x - s2)(s1 - s0)     Kd
+    **
+    ** With (P1 - P2) / (P1 - P0) = -5 / 7 this gives:
+    **
+    ** P = 5000 * (9 * 5 * Kd + 21 * 7 * Kn) / (5 * Kd + 7 * Kn)
+    **
+    ** Kn & Kd are < 2^54, so the numerator is < 2^62...
+    */
+    Kn = (x - s0) * (s1 - s2);
+    Kd = (x - s2) * (s1 - s0);
+
+    num = 
+        ICP_P_CALIB_0 * (ICP_P_CALIB_2 - ICP_P_CALIB_1) * Kd + 
+        ICP_P_CALIB_2 * (ICP_P_CALIB_1 - ICP_P_CALIB_0) * Kn;
+    den = 
+        (ICP_P_CALIB_2 - ICP_P_CALIB_1) * Kd + 
+        (ICP_P_CALIB_1 - ICP_P_CALIB_0) * Kn;
+
+    if (den == 0) {
+        return -1;
     }
 
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+
+    q = num / den;
+    r = num % den;
+
+    while (den >= (1LL << ICP_DIVISOR_MAX_BITS)) {
+        den >>= 1;
+        r /= 2;
+    }
+
+    /*
+    ** Truncate towards zero, as the (int) cast in the float version...
+    */
+    *pressure = (int)(
+                    ((ICP_P_CALIB_UNIT * q << ICP_P_FRACTION_BITS) + 
+                    _divRound(ICP_P_CALIB_UNIT * r << ICP_P_FRACTION_BITS, den)) / 
+                    (1LL << ICP_P_FRACTION_BITS));
+
     return 0;
 }
 
-void icp10125_process_data(const int p_LSB, const int T_LSB, int * pressure) { 
+#ifdef UNIT_TEST_MODE
+/*
+** The original float implementation, kept as the reference to validate 
+** the fixed point version against on the host...
+*/
+static const float p_Pa_calib[3] = {45000.0f, 80000.0f, 105000.0f};
+static const float LUT_lower = 3670016.0f;
+static const float LUT_upper = 12058624.0f;
+static const float quadr_factor = 0.000000059605f;
+static const float offst_factor = 2048.0;
+
+static void calculate_conversion_constants(const float *p_Pa, const float *p_LUT, float *out) { 
+    float A, B, C; 
+    
+    C = (p_LUT[0] * p_LUT[1] * (p_Pa[0] - p_Pa[1]) + 
+    p_LUT[1] * p_LUT[2] * (p_Pa[1] - p_Pa[2]) + 
+    p_LUT[2] * p_LUT[0] * (p_Pa[2] - p_Pa[0])) / 
+    (p_LUT[2] * (p_Pa[0] - p_Pa[1]) + 
+    p_LUT[0] * (p_Pa[1] - p_Pa[2]) + 
+    p_LUT[1] * (p_Pa[2] - p_Pa[0])); 
+    A = (p_Pa[0] * p_LUT[0] - p_Pa[1] * p_LUT[1] - (p_Pa[1] - p_Pa[0]) * C) / (p_LUT[0] - p_LUT[1]); 
+    B = (p_Pa[0] - A) * (p_LUT[0] + C); 
+    
+    out[0] = A; 
+    out[1] = B; 
+    out[2] = C; 
+}
+
+void icp10125_process_data_float(const int p_LSB, const int T_LSB, int * pressure) { 
     float t; 
     float s1, s2, s3; 
     float in[3]; 
     float out[3]; 
     float A, B, C; 
+    float sensor_constants[4];
+    int   i;
+
+    for (i = 0; i < 4; i++) {
+        sensor_constants[i] = (float)otpValues[i];
+    }
     
     t = (float)(T_LSB - 32768); 
     s1 = LUT_lower + (float)(sensor_constants[0] * t * t) * quadr_factor; 
@@ -130,3 +355,4 @@ void icp10125_process_data(const int p_LSB, const int T_LSB, int * pressure) {
     
     *pressure = (int)(A + B / (C + p_LSB)); 
 }
+#endif
@@ -1,6 +1,9 @@
 #include <stdint.h>
+#include <stdbool.h>
 
+#ifndef UNIT_TEST_MODE
 #include "hardware/i2c.h"
+#endif
 #include "i2c_addr.h"
 
 #ifndef __INCL_ICP10125
@@ -8,9 +11,18 @@
 
 #define ICP10125_CMD_MEASURE_LOW_NOISE      0x70DF
 
+#ifndef UNIT_TEST_MODE
+int     icp10125_probe(i2c_inst_t * i2c);
 int     icp10125_setup(i2c_inst_t * i2c);
 int     icp10125_read_otp(i2c_inst_t * i2c);
-void    icp10125_process_data(
+#else
+void    icp10125_set_otp(const uint16_t * otp);
+void    icp10125_process_data_float(
+                const int p_LSB, 
+                const int T_LSB, 
+                int *pressure);
+#endif
+int     icp10125_process_data(
                 const int p_LSB, 
                 const int T_LSB, 
                 int *pressure);
@@ -29,16 +29,40 @@
 #include "sensor.h"
 #include "icp10125.h"
 #include "nRF24L01.h"
+#include "radio.h"
+#include "power_rp2040.h"
+#include "clock_rp2040.h"
 #include "utils.h"
 #include "gpio_def.h"
+#include "gpio_cntrl.h"
+#include "flashlog.h"
+#include "persist.h"
+#include "crash.h"
 
 #define ENABLE_BATTERY_MONITOR
 
+/*
+** Runs when the debug enable pin changes, signalled from the GPIO edge
+** interrupt. The pin may bounce, so only act when the level has changed...
+*/
 void taskDebugCheck(PTASKPARM p) {
-    if (isDebugActive()) {
+    static int      lastState = -1;
+    int             state;
+
+    state = (isDebugActive() ? 1 : 0);
+
+    if (state == lastState) {
+        return;
+    }
+
+    lastState = state;
+
+    if (state) {
 		initSerial(uart0);
 
 		lgOpen(uart0, LOG_LEVEL_FATAL | LOG_LEVEL_ERROR | LOG_LEVEL_STATUS | LOG_LEVEL_DEBUG | LOG_LEVEL_INFO);
+
+        scheduleTask(TASK_HEARTBEAT, RUN_NOW, false, NULL);
     }
     else {
         lgSetLogLevel(LOG_LEVEL_OFF);
@@ -53,19 +77,38 @@ static void setup(void) {
 	*/
 	watchdog_disable();
 
-    set_sys_clock_khz(24000, true);
+    /*
+    ** Run from the crystal, tasks ask for a faster clock when
+    ** they need it...
+    */
+    clockInit();
 
 	setupLEDPin();
     setupDebugPin();
 	setupRTC();
 
     pioInit();
+
+    /*
+    ** Find where the reading log left off...
+    */
+    flashLogInit();
+
+    /*
+    ** Carry the packet number & rain total on from before we reset...
+    */
+    persistInit();
+
+    /*
+    ** Pick up anything recorded before we reset & start tracing...
+    */
+    crashInit();
 }
 
 int main(void) {
 	setup();
 
-	initScheduler(7);
+	initScheduler(SCHED_MAX_TASKS);
 
 	registerTask(TASK_HEARTBEAT, &HeartbeatTask);
 	registerTask(TASK_WATCHDOG, &taskWatchdog);
@@ -74,6 +117,32 @@ int main(void) {
     registerTask(TASK_RAIN_GAUGE, &taskRainGuage);
     registerTask(TASK_BATTERY_MONITOR, &taskBatteryMonitor);
     registerTask(TASK_DEBUG_CHECK, &taskDebugCheck);
+    registerTask(TASK_RADIO, &taskRadio);
+
+    /*
+    ** The watchdog must never be starved and the PIO FIFOs must be
+    ** drained before they overflow, the rest can wait their turn...
+    */
+    setTaskPriority(TASK_WATCHDOG, TASK_PRIORITY_HIGHEST);
+    setTaskPriority(TASK_ANEMOMETER, 1);
+    setTaskPriority(TASK_RAIN_GAUGE, 1);
+    setTaskPriority(TASK_I2C_SENSOR, 2);
+    setTaskPriority(TASK_RADIO, 2);
+    setTaskPriority(TASK_DEBUG_CHECK, 4);
+    setTaskPriority(TASK_HEARTBEAT, TASK_PRIORITY_LOWEST);
+
+#ifdef PICO_MULTICORE
+    /*
+    ** Run the radio on core 1, so the sensor chain on core 0 can
+    ** carry on shutting down the I2C bus while we transmit...
+    */
+    setTaskAttributes(TASK_RADIO, false);
+#endif
+
+    gpioSignalTaskOnEdge(
+            DEBUG_ENABLE_PIN, 
+            GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, 
+            TASK_DEBUG_CHECK);
 
 	scheduleTask(
 			TASK_HEARTBEAT,
@@ -103,10 +172,16 @@ int main(void) {
             NULL);
 
 #ifdef ENABLE_BATTERY_MONITOR
+    /*
+    ** The battery monitor is signalled by the gauge alert, check the 
+    ** first battery reading in case we're already low...
+    */
+    batteryInit();
+
     scheduleTask(
             TASK_BATTERY_MONITOR,
-            rtc_val_sec(15),
-            true,
+            rtc_val_min(1),
+            false,
             NULL);
 #endif
 
@@ -116,18 +191,35 @@ int main(void) {
             true, 
 			NULL);
 
+	/*
+	** Pick up the initial state of the debug pin, after that the
+	** task is signalled when the pin changes...
+	*/
 	scheduleTask(
 			TASK_DEBUG_CHECK, 
 			rtc_val_sec(1), 
-            true, 
+            false, 
 			NULL);
 
+	/*
+	** The tasks that must keep running, the watchdog is only fed
+	** while they all check in on time...
+	*/
+	watchdogRegisterTask(TASK_ANEMOMETER, rtc_val_sec(5));
+	watchdogRegisterTask(TASK_RAIN_GAUGE, rtc_val_min(2));
+	watchdogRegisterTask(TASK_I2C_SENSOR, rtc_val_sec(5 + SENSOR_CYCLE_MAX_SEC));
+
 	/*
 	** Enable the watchdog, it will reset the device in 3s unless
 	** the watchdog timer is updated by WatchdogTask()...
 	*/
 	watchdog_enable(3000, false);
 
+	/*
+	** Sleep with the unused clocks gated when there's nothing to do...
+	*/
+	powerInit();
+
 	/*
 	** Start the scheduler...
 	*/
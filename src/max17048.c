@@ -10,34 +10,178 @@
 #include "utils.h"
 #include "logger.h"
 
+/*
+** The MAX17048 is powered from the battery, not the switched I2C rail, so
+** it keeps its configuration between cycles and only needs setting up 
+** once. The last CONFIG value written is cached to save re-reading it...
+*/
+static bool             isConfigured = false;
+static uint16_t         config;
+
+static int _writeRegister(i2c_inst_t * i2c, uint8_t reg, uint16_t value) {
+    uint8_t         data[3];
+
+    data[0] = reg;
+    data[1] = (uint8_t)((value >> 8) & 0xFF);
+    data[2] = (uint8_t)(value & 0xFF);
+
+    return i2cWriteTimeoutProtected(i2c, MAX17048_ADDRESS, data, 3);
+}
+
+/*
+** The version register reads 0x001X...
+*/
+int max17048_probe(i2c_inst_t * i2c) {
+    int             error;
+    uint8_t         version[2];
+
+    error = i2cReadRegister(i2c, MAX17048_ADDRESS, MAX17048_REG_VERSION, version, 2);
+
+    if (error < 0) {
+        return error;
+    }
+
+    if ((copyI2CReg_uint16(version) & 0xFFF0) != 0x0010) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    return 0;
+}
+
 int max17048_setup(i2c_inst_t * i2c) {
-    uint8_t         data[8];
+    int             error;
     uint8_t         configReg[2];
 
-    data[0] = MAX17048_REG_MODE;
-    data[1] = 0x00;
-    data[2] = 0x00;
+    if (isConfigured) {
+        return 0;
+    }
+
+    _writeRegister(i2c, MAX17048_REG_MODE, 0x0000);
 
-    i2cWriteTimeoutProtected(i2c, MAX17048_ADDRESS, data, 3, false);
+    error = i2cReadRegister(i2c, MAX17048_ADDRESS, MAX17048_REG_CONFIG, configReg, 2);
 
-    i2cReadRegister(i2c, MAX17048_ADDRESS, MAX17048_REG_CONFIG, configReg, 2);
+    if (error < 0) {
+        return error;
+    }
 
     configReg[1] = (configReg[1] & 0x7F) | 0x80;
 
-    data[0] = MAX17048_REG_CONFIG;
-    data[1] = configReg[0];
-    data[2] = configReg[1];
+    config = copyI2CReg_uint16(configReg);
+
+    error = _writeRegister(i2c, MAX17048_REG_CONFIG, config);
+
+    if (error < 0) {
+        return error;
+    }
+
+    /*
+    ** Always use hibernate mode to save power...
+    */
+    error = _writeRegister(i2c, MAX17048_REG_HIBRT, MAX17048_HIBRT_ALWAYS);
+
+    if (error < 0) {
+        return error;
+    }
+
+    isConfigured = true;
+
+    return 0;
+}
+
+/*
+** Read the cell voltage, SOC and CONFIG (for the alert flag) in one burst,
+** they are consecutive registers, then the charge rate...
+*/
+int max17048_read_gauge(i2c_inst_t * i2c, max17048_gauge_t * gauge) {
+    int             error;
+    uint8_t         buffer[MAX17048_REG_CONFIG + 2 - MAX17048_REG_VCELL];
+
+    error = i2cReadRegister(
+                    i2c, 
+                    MAX17048_ADDRESS, 
+                    MAX17048_REG_VCELL, 
+                    buffer, 
+                    sizeof(buffer));
+
+    if (error < 0) {
+        return error;
+    }
+
+    gauge->rawVolts = copyI2CReg_uint16(&buffer[MAX17048_REG_VCELL - MAX17048_REG_VCELL]);
+    gauge->rawPercentage = buffer[MAX17048_REG_SOC - MAX17048_REG_VCELL];
+    gauge->rawSOC = copyI2CReg_uint16(&buffer[MAX17048_REG_SOC - MAX17048_REG_VCELL]);
+    gauge->config = copyI2CReg_uint16(&buffer[MAX17048_REG_CONFIG - MAX17048_REG_VCELL]);
+
+    config = gauge->config;
+
+    error = i2cReadRegister(i2c, MAX17048_ADDRESS, MAX17048_REG_CRATE, buffer, 2);
+
+    if (error < 0) {
+        return error;
+    }
+
+    gauge->rawChargeRate = copyI2CReg_int16(buffer);
+
+    return 0;
+}
+
+bool max17048_is_alert(const max17048_gauge_t * gauge) {
+    return ((gauge->config & MAX17048_CONFIG_ALRT) ? true : false);
+}
+
+/*
+** The SOC threshold (1 - 32%) below which the ALRT pin is pulled low...
+*/
+uint8_t max17048_get_alert_threshold(void) {
+    return (uint8_t)(32 - (config & MAX17048_CONFIG_ATHD_MASK));
+}
+
+/*
+** Clear any alert and set the SOC alert threshold, only touching the 
+** gauge if something has changed...
+*/
+int max17048_set_alert(i2c_inst_t * i2c, uint8_t thresholdPercentage) {
+    int             error;
+    uint16_t        newConfig;
+    bool            isAlert;
+
+    if (thresholdPercentage < 1) {
+        thresholdPercentage = 1;
+    }
+    else if (thresholdPercentage > 32) {
+        thresholdPercentage = 32;
+    }
+
+    isAlert = (config & MAX17048_CONFIG_ALRT) ? true : false;
+
+    newConfig = 
+        (config & ~(MAX17048_CONFIG_ALRT | MAX17048_CONFIG_ATHD_MASK)) | 
+        (uint16_t)(32 - thresholdPercentage);
+
+    if (newConfig == config) {
+        return 0;
+    }
+
+    error = _writeRegister(i2c, MAX17048_REG_CONFIG, newConfig);
+
+    if (error < 0) {
+        return error;
+    }
+
+    config = newConfig;
 
-    i2cWriteTimeoutProtected(i2c, MAX17048_ADDRESS, data, 3, false);
+    /*
+    ** The alert flags in STATUS are sticky too...
+    */
+    if (isAlert) {
+        error = _writeRegister(i2c, MAX17048_REG_STATUS, 0x0000);
 
-    // /*
-    // ** Always use hibernate mode to save power...
-    // */
-    // data[0] = MAX17048_REG_HIBRT;
-    // data[1] = 0xFF;
-    // data[2] = 0xFF;
+        if (error < 0) {
+            return error;
+        }
+    }
 
-    // i2cWriteTimeoutProtected(i2c, MAX17048_ADDRESS, data, 3, false);
+    lgLogDebug("MAX17048 alert threshold %d%%", (int)thresholdPercentage);
 
     return 0;
 }
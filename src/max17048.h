@@ -1,3 +1,7 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hardware/i2c.h"
 #include "i2c_addr.h"
 
 #ifndef __INCL_MAX17048
@@ -17,7 +21,30 @@
 #define MAX17048_REG_CMD            0xFE
 
 #define MAX17048_CONFIG_SLEEP       0x0080
+#define MAX17048_CONFIG_ALSC        0x0040
+#define MAX17048_CONFIG_ALRT        0x0020
+#define MAX17048_CONFIG_ATHD_MASK   0x001F
+
+/*
+** Hibernate all the time, the gauge then samples every 45s rather than
+** every 250ms, which is plenty for a reading every few minutes...
+*/
+#define MAX17048_HIBRT_ALWAYS       0xFFFF
+
+typedef struct {
+    uint16_t            rawVolts;
+    uint8_t             rawPercentage;
+    uint16_t            rawSOC;
+    int16_t             rawChargeRate;
+    uint16_t            config;
+}
+max17048_gauge_t;
 
-int max17048_setup(i2c_inst_t * i2c);
+int         max17048_probe(i2c_inst_t * i2c);
+int         max17048_setup(i2c_inst_t * i2c);
+int         max17048_read_gauge(i2c_inst_t * i2c, max17048_gauge_t * gauge);
+bool        max17048_is_alert(const max17048_gauge_t * gauge);
+uint8_t     max17048_get_alert_threshold(void);
+int         max17048_set_alert(i2c_inst_t * i2c, uint8_t thresholdPercentage);
 
 #endif
@@ -187,6 +187,17 @@ int _transmit(
     }
 
     spiWriteReadByte(spi, NRF24L01_SPI_PIN_CSN, NRF24L01_CMD_FLUSH_TX, &statusReg, false);
+
+    /*
+    ** Clear the result of the last packet, so nRF24L01_get_tx_result() 
+    ** sees the result of this one...
+    */
+    nRF24L01_writeRegister(
+                spi, 
+                NRF24L01_REG_STATUS, 
+                NRF24L01_STATUS_CLEAR_TX_DS | NRF24L01_STATUS_CLEAR_MAX_RT, 
+                &statusReg);
+
     spiWriteReadByte(spi, NRF24L01_SPI_PIN_CSN, command, &statusReg, true);
     spiWriteData(spi, NRF24L01_SPI_PIN_CSN, buf, 32, false);
 
@@ -203,12 +214,6 @@ int _transmit(
 
     gpio_put(NRF24L01_SPI_PIN_CE, false);
 
-    /*
-    ** Clear the TX_DS bit...
-    */
-    spiWriteReadByte(spi, NRF24L01_SPI_PIN_CSN, NRF24L01_CMD_W_REGISTER | NRF24L01_REG_STATUS, &statusReg, true);
-    spiWriteByte(spi, NRF24L01_SPI_PIN_CSN, (statusReg & 0xDF), false);
-
     return 0;
 }
 
@@ -229,10 +234,18 @@ int nRF24L01_setup(spi_inst_t * spi) {
 
     sleep_ms(2);
 
-    nRF24L01_writeRegister(spi, NRF24L01_REG_EN_AA, 0x00, &statusReg);
+    /*
+    ** Auto acknowledge on pipe 0, packets sent with requestACK are
+    ** retransmitted until the base station ACKs them or we give up...
+    */
+    nRF24L01_writeRegister(spi, NRF24L01_REG_EN_AA, 0x01, &statusReg);
     nRF24L01_writeRegister(spi, NRF24L01_REG_EN_RXADDR, 0x01, &statusReg);
     nRF24L01_writeRegister(spi, NRF24L01_REG_SETUP_AW, 0x03, &statusReg);
-    nRF24L01_writeRegister(spi, NRF24L01_REG_SETUP_RETR, 0x00, &statusReg);
+    nRF24L01_writeRegister(
+                    spi, 
+                    NRF24L01_REG_SETUP_RETR, 
+                    NRF24L01_RETR_DELAY_1000US | NRF24L01_RETR_COUNT_5, 
+                    &statusReg);
 
     /*
     ** Set the RF channel to use...
@@ -259,7 +272,11 @@ int nRF24L01_setup(spi_inst_t * spi) {
                     NRF24L01_STATUS_CLEAR_TX_DS, 
                     &statusReg);
 
-    _setRxAddress(spi, 0, NRF24L01_LOCAL_ADDRESS);
+    /*
+    ** The ACK comes back from the base station's address, so pipe 0
+    ** must listen on it...
+    */
+    _setRxAddress(spi, 0, NRF24L01_REMOTE_ADDRESS);
     _setTxAddress(spi, NRF24L01_REMOTE_ADDRESS);
 
     /*
@@ -331,6 +348,41 @@ int nRF24L01_transmit_buffer(
     return error;
 }
 
+/*
+** The result of the last packet sent: 0 if it was sent (& ACKed, if it
+** asked for an ACK), PICO_ERROR_TIMEOUT if the retries ran out without 
+** an ACK, or PICO_ERROR_GENERIC if it hasn't finished. Any packet that
+** didn't make it is dropped from the TX FIFO...
+*/
+int nRF24L01_get_tx_result(spi_inst_t * spi) {
+    uint8_t             statusReg = 0;
+    int                 result;
+
+    spiWriteReadByte(spi, NRF24L01_SPI_PIN_CSN, NRF24L01_CMD_NOP, &statusReg, false);
+
+    if (statusReg & NRF24L01_STATUS_R_TX_DS) {
+        result = 0;
+    }
+    else if (statusReg & NRF24L01_STATUS_R_MAX_RT) {
+        result = PICO_ERROR_TIMEOUT;
+    }
+    else {
+        result = PICO_ERROR_GENERIC;
+    }
+
+    if (result) {
+        spiWriteReadByte(spi, NRF24L01_SPI_PIN_CSN, NRF24L01_CMD_FLUSH_TX, &statusReg, false);
+    }
+
+    nRF24L01_writeRegister(
+                spi, 
+                NRF24L01_REG_STATUS, 
+                NRF24L01_STATUS_CLEAR_TX_DS | NRF24L01_STATUS_CLEAR_MAX_RT, 
+                &statusReg);
+
+    return result;
+}
+
 int nRF24L01_transmit_string(
             spi_inst_t * spi, 
             char * pszText, 
@@ -90,8 +90,18 @@
 
 #define NRF24L01_STATUS_R_TX_FIFO_FULL              0x01
 #define NRF24L01_STATUS_R_RX_FIFO_EMPTY             0x0E
+#define NRF24L01_STATUS_R_MAX_RT                    0x10
+#define NRF24L01_STATUS_R_TX_DS                     0x20
 #define NRF24L01_STATUS_R_RX_DR                     0x40
 
+/*
+** SETUP_RETR register, auto retransmit delay (250us steps from 250us)
+** in the top nibble & count in the bottom. At 250kbps the delay must be
+** at least 500us to receive the ACK...
+*/
+#define NRF24L01_RETR_DELAY_1000US                  0x30
+#define NRF24L01_RETR_COUNT_5                       0x05
+
 #define NRF24L01_ACTIVATE_SPECIAL_BYTE              0x73
 
 /*
@@ -110,6 +120,7 @@ int nRF24L01_transmit_buffer(
             uint8_t * buf, 
             int length, 
             bool requestACK);
+int nRF24L01_get_tx_result(spi_inst_t * spi);
 int nRF24L01_transmit_string(
             spi_inst_t * spi, 
             char * pszText, 
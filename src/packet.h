@@ -7,6 +7,7 @@
 #define PACKET_ID_WEATHER                           0x55
 #define PACKET_ID_SLEEP                             0xAA
 #define PACKET_ID_WATCHDOG                          0x96
+#define PACKET_ID_WEATHER_LOG                       0x5A
 
 /*
 ** Status bits:
@@ -52,11 +53,15 @@ typedef struct {                                    // O/S  - Description
     uint32_t            rawICPPressure;             // 0x0C - Raw pressure from icp10125
     uint16_t            rawHumidity;                // 0x10 - Raw I2C SHT4x value
 
-    uint16_t            rawRainfall;                // 0x12 - Raw rain sensor count
+    uint16_t            rawRainfall;                // 0x12 - Raw rain tip count since boot (wraps)
     uint16_t            rawWindspeed;               // 0x14 - Raw wind speed
     uint16_t            rawWindGust;                // 0x16 - Raw wind gust speed
 
-    uint8_t             padding[8];                 // 0x18
+    uint16_t            rawRainLastHour;            // 0x18 - Raw rain tip count in the last hour
+    uint16_t            rawRainRateMax;             // 0x1A - Max rain rate in the last hour (tips/hr)
+
+    uint8_t             rawI2CHealth;               // 0x1C - I2C bus health, see i2c_rp2040.h
+    uint8_t             padding[3];                 // 0x1D
 }
 weather_packet_t;
 
@@ -76,15 +81,58 @@ typedef struct {                                    // O/S  - Description
 }
 sleep_packet_t;
 
+typedef struct {
+    uint16_t            taskID;
+    uint16_t            runTime;                    // us, capped at 65535
+}
+watchdog_trace_t;
+
+#define WATCHDOG_TRACE_LENGTH                       4
+
 typedef struct {                                    // O/S  - Description
                                                     // ----   ---------------------------------
-    uint8_t             packetID;                   // 0x00 - Identify this as a weather packet
-    uint8_t             reserved;                   // 0x01 - Reserved
-    uint16_t            status;                     // 0x02 - Status bits
+    uint8_t             packetID;                   // 0x00 - Identify this as a watchdog packet
+    uint8_t             resetReason;                // 0x01 - Why we last reset, see crash.h
+    uint16_t            errorCode;                  // 0x02 - Scheduler error code or stalled task ID, 0 if none
+
+    uint16_t            bootCount;                  // 0x04 - Number of times we've booted
+    uint16_t            lastTaskID;                 // 0x06 - The task running when we reset, 0xFFFF if none
+
+    uint32_t            lastTaskRunTime;            // 0x08 - How long it had run (us), 0xFFFFFFFF if unknown
 
-    uint8_t             padding[28];
+    uint8_t             lastTaskCore;               // 0x0C - The core it was running on
+    uint8_t             traceCount;                 // 0x0D - Number of valid trace entries
+
+    watchdog_trace_t    trace[WATCHDOG_TRACE_LENGTH];   // 0x0E - Last tasks run on that core, newest first
+
+    uint8_t             padding[2];                 // 0x1E
 }
 watchdog_packet_t;
+
+typedef struct {                                    // O/S  - Description
+                                                    // ----   ---------------------------------
+    uint8_t             packetID;                   // 0x00 - Identify this as a logged weather packet
+
+    uint8_t             sequence[3];                // 0x01 - Log record sequence number (24-bit)
+
+    uint8_t             status;                     // 0x04 - Status bits when the reading was taken
+
+    uint8_t             rawBatteryPercentage;       // 0x05 - Raw I2C value for battery %
+    uint16_t            rawBatteryVolts;            // 0x06 - Raw I2C value for battery V
+
+    int16_t             rawTemperature;             // 0x08 - Raw I2C TMP117 value
+    uint16_t            rawHumidity;                // 0x0A - Raw I2C SHT4x value
+    uint32_t            rawICPPressure;             // 0x0C - Raw pressure from icp10125
+
+    uint16_t            rawRainfall;                // 0x10 - Raw rain tip count (wraps)
+    uint16_t            rawWindspeed;               // 0x12 - Raw wind speed
+    uint16_t            rawWindGust;                // 0x14 - Raw wind gust speed
+
+    uint32_t            ageMinutes;                 // 0x16 - How long ago the reading was taken, 0xFFFFFFFF if unknown
+
+    uint8_t             padding[6];                 // 0x1A
+}
+weather_log_packet_t;
 #pragma pack(pop)
 
 weather_packet_t *  getWeatherPacket(void);
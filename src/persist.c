@@ -0,0 +1,180 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hardware/watchdog.h"
+#include "hardware/structs/watchdog.h"
+#include "logger.h"
+#include "rain.h"
+#include "flash_rp2040.h"
+#include "flashlog.h"
+#include "persist.h"
+
+#define JOURNAL_ENTRY_COUNT                 (PERSIST_JOURNAL_SIZE / sizeof(persist_entry_t))
+#define ENTRIES_PER_SECTOR                  (FLASH_SECTOR_SIZE / sizeof(persist_entry_t))
+
+#define SEQUENCE_ERASED                     0xFFFFFFFF
+
+/*
+** The counters the base station relies on to spot missing packets and
+** reconstruct the rainfall, these must carry on across a reset...
+*/
+static uint32_t             packetNum = 0;
+static uint16_t             bootCount = 0;
+static uint8_t              resetReason = PERSIST_RESET_POWER_ON;
+
+static uint32_t             journalSlot = 0;
+static uint32_t             journalSequence = 0;
+
+static uint32_t _getScratchChecksum(void) {
+    return ~(
+        watchdog_hw->scratch[PERSIST_SCRATCH_MAGIC_BOOT] ^ 
+        watchdog_hw->scratch[PERSIST_SCRATCH_PACKET_NUM] ^ 
+        watchdog_hw->scratch[PERSIST_SCRATCH_RAIN_TOTAL]);
+}
+
+static bool _isScratchValid(void) {
+    return (
+        (watchdog_hw->scratch[PERSIST_SCRATCH_MAGIC_BOOT] >> 16) == PERSIST_MAGIC && 
+        watchdog_hw->scratch[PERSIST_SCRATCH_CHECKSUM] == _getScratchChecksum());
+}
+
+static inline uint32_t _getSlotOffset(uint32_t slot) {
+    return PERSIST_JOURNAL_OFFSET + (slot * sizeof(persist_entry_t));
+}
+
+static bool _readEntry(uint32_t slot, persist_entry_t * e) {
+    if (flashRead(_getSlotOffset(slot), (uint8_t *)e, sizeof(persist_entry_t))) {
+        return false;
+    }
+
+    return (
+        e->sequence != SEQUENCE_ERASED && 
+        e->crc == flashCRC16((const uint8_t *)e, offsetof(persist_entry_t, crc)));
+}
+
+/*
+** Find the latest entry in the journal, returns false if there isn't one...
+*/
+static bool _scanJournal(persist_entry_t * latest) {
+    persist_entry_t     e;
+    uint32_t            slot;
+    bool                isFound = false;
+
+    for (slot = 0;slot < JOURNAL_ENTRY_COUNT;slot++) {
+        if (_readEntry(slot, &e) && (!isFound || e.sequence > latest->sequence)) {
+            memcpy(latest, &e, sizeof(persist_entry_t));
+            journalSlot = (slot + 1) % JOURNAL_ENTRY_COUNT;
+            isFound = true;
+        }
+    }
+
+    if (isFound) {
+        journalSequence = latest->sequence + 1;
+    }
+
+    return isFound;
+}
+
+static void _writeJournal(void) {
+    persist_entry_t     e;
+    uint32_t            tries;
+
+    e.sequence = journalSequence;
+    e.packetNum = packetNum;
+    e.rainTotal = rainGetTotalTips();
+    e.bootCount = bootCount;
+    e.crc = flashCRC16((const uint8_t *)&e, offsetof(persist_entry_t, crc));
+
+    /*
+    ** Skip any slot torn by a power failure. The other sector still
+    ** holds the previous entries while we erase this one...
+    */
+    for (tries = 0;tries < JOURNAL_ENTRY_COUNT;tries++) {
+        if ((journalSlot % ENTRIES_PER_SECTOR) == 0 && 
+            !flashIsErased(_getSlotOffset(journalSlot), FLASH_SECTOR_SIZE))
+        {
+            flashEraseSector(_getSlotOffset(journalSlot));
+        }
+
+        if (flashIsErased(_getSlotOffset(journalSlot), sizeof(persist_entry_t))) {
+            break;
+        }
+
+        journalSlot = (journalSlot + 1) % JOURNAL_ENTRY_COUNT;
+    }
+
+    if (flashProgram(_getSlotOffset(journalSlot), (const uint8_t *)&e, sizeof(persist_entry_t)) == 0) {
+        journalSlot = (journalSlot + 1) % JOURNAL_ENTRY_COUNT;
+        journalSequence++;
+    }
+}
+
+/*
+** Restore the counters, from the scratch registers if they survived the
+** reset, otherwise from the journal...
+*/
+void persistInit(void) {
+    persist_entry_t     latest;
+    bool                isJournalled;
+
+    resetReason = watchdog_caused_reboot() ? PERSIST_RESET_WATCHDOG : PERSIST_RESET_POWER_ON;
+
+    isJournalled = _scanJournal(&latest);
+
+    if (_isScratchValid()) {
+        bootCount = (uint16_t)(watchdog_hw->scratch[PERSIST_SCRATCH_MAGIC_BOOT] & 0xFFFF);
+        packetNum = watchdog_hw->scratch[PERSIST_SCRATCH_PACKET_NUM];
+        rainSetTotalTips(watchdog_hw->scratch[PERSIST_SCRATCH_RAIN_TOTAL]);
+    }
+    else if (isJournalled) {
+        bootCount = latest.bootCount;
+        packetNum = latest.packetNum;
+        rainSetTotalTips(latest.rainTotal);
+    }
+
+    bootCount++;
+
+    persistSave();
+
+    lgLogInfo(
+        "Boot %d (%s), packet %d", 
+        (int)bootCount, 
+        (resetReason == PERSIST_RESET_WATCHDOG ? "watchdog" : "power on"), 
+        (int)packetNum);
+}
+
+/*
+** Cheap enough to call whenever a counter changes...
+*/
+void persistSaveScratch(void) {
+    watchdog_hw->scratch[PERSIST_SCRATCH_MAGIC_BOOT] = ((uint32_t)PERSIST_MAGIC << 16) | bootCount;
+    watchdog_hw->scratch[PERSIST_SCRATCH_PACKET_NUM] = packetNum;
+    watchdog_hw->scratch[PERSIST_SCRATCH_RAIN_TOTAL] = rainGetTotalTips();
+    watchdog_hw->scratch[PERSIST_SCRATCH_CHECKSUM] = _getScratchChecksum();
+}
+
+/*
+** Save to the scratch registers & the journal, called once per packet...
+*/
+void persistSave(void) {
+    persistSaveScratch();
+    _writeJournal();
+}
+
+uint32_t persistGetPacketNumber(void) {
+    return packetNum;
+}
+
+void persistSetPacketNumber(uint32_t n) {
+    packetNum = n;
+}
+
+uint16_t persistGetBootCount(void) {
+    return bootCount;
+}
+
+uint8_t persistGetResetReason(void) {
+    return resetReason;
+}
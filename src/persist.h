@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash_rp2040.h"
+#include "flashlog.h"
+
+#ifndef __INCL_PERSIST
+#define __INCL_PERSIST
+
+/*
+** Watchdog scratch registers 4 - 7 are used by the bootrom for
+** watchdog_reboot(), we use 0 - 3...
+*/
+#define PERSIST_SCRATCH_MAGIC_BOOT          0
+#define PERSIST_SCRATCH_PACKET_NUM          1
+#define PERSIST_SCRATCH_RAIN_TOTAL          2
+#define PERSIST_SCRATCH_CHECKSUM            3
+
+#define PERSIST_MAGIC                       0x5EED
+
+/*
+** The scratch registers are cleared by a power cycle, so we also keep
+** a journal in the two sectors below the reading log. One sector is 
+** erased only once the other is full...
+*/
+#define PERSIST_JOURNAL_SECTORS             2
+#define PERSIST_JOURNAL_SIZE                (PERSIST_JOURNAL_SECTORS * FLASH_SECTOR_SIZE)
+#define PERSIST_JOURNAL_OFFSET              (FLASHLOG_OFFSET - PERSIST_JOURNAL_SIZE)
+
+#define PERSIST_RESET_POWER_ON              0x00
+#define PERSIST_RESET_WATCHDOG              0x01
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t            sequence;
+    uint32_t            packetNum;
+    uint32_t            rainTotal;
+    uint16_t            bootCount;
+    uint16_t            crc;
+}
+persist_entry_t;
+#pragma pack(pop)
+
+void        persistInit(void);
+void        persistSaveScratch(void);
+void        persistSave(void);
+uint32_t    persistGetPacketNumber(void);
+void        persistSetPacketNumber(uint32_t packetNum);
+uint16_t    persistGetBootCount(void);
+uint8_t     persistGetResetReason(void);
+
+#endif
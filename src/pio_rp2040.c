@@ -12,6 +12,9 @@
 #include "scheduler.h"
 #include "taskdef.h"
 #include "sensor.h"
+#include "rain.h"
+#include "persist.h"
+#include "watchdog.h"
 
 #include "pulsecount.pio.h"
 
@@ -115,6 +118,25 @@ void disablePIO(void) {
     }
 }
 
+/*
+** Restart the pulse counters after disablePIO(), the programs and
+** state machines stay loaded, so we don't need to go through pioInit()...
+*/
+void enablePIO(void) {
+    if (!isPIOEnabled) {
+        pio_sm_clear_fifos(pio0, anemometerSM);
+        pio_sm_clear_fifos(pio0, rainGaugeSM);
+
+        pio_sm_restart(pio0, anemometerSM);
+        pio_sm_restart(pio0, rainGaugeSM);
+
+        pio_sm_set_enabled(pio0, anemometerSM, true);
+        pio_sm_set_enabled(pio0, rainGaugeSM, true);
+
+        isPIOEnabled = true;
+    }
+}
+
 /*
 ** Python example from: 
 ** https://github.com/raspberrypilearning/build-your-own-weather-station/
@@ -144,11 +166,15 @@ void taskAnemometer(PTASKPARM p) {
     static int          ix = 0;
     static int          runCount = 0;
     static uint32_t     pulseCount = 0;
+    static uint16_t     lastMissedCount = 0;
+    uint16_t            missedCount;
     int                 i;
     uint32_t            totalCount = 0;
     uint32_t            maxCount = 0;
     weather_packet_t *  pWeather;
 
+    watchdogCheckIn(TASK_ANEMOMETER);
+
     /*
     ** Pulses are bitshifted into the RX_FIFO by the PIO.
     ** The PIO is setup to auto-push 2 bits into the FIFO
@@ -159,9 +185,16 @@ void taskAnemometer(PTASKPARM p) {
     pulseCount += (pio_sm_get_rx_fifo_level(pio0, anemometerSM) * ANEMOMETER_PULSE_COUNT_BIT_SHIFT);
     pio_sm_clear_fifos(pio0, anemometerSM);
     
-    runCount++;
+    /*
+    ** The window is timed by counting runs, so count any periods the 
+    ** scheduler had to skip as runs too...
+    */
+    missedCount = getTaskMissedPeriods(TASK_ANEMOMETER);
+
+    runCount += 1 + (uint16_t)(missedCount - lastMissedCount);
+    lastMissedCount = missedCount;
 
-    if (runCount == PIO_ANEMOMETER_TASK_RUNS) {
+    if (runCount >= PIO_ANEMOMETER_TASK_RUNS) {
         /*
         ** Our pulse count is number of pulses every 5 seconds...
         */
@@ -206,9 +239,9 @@ void taskAnemometer(PTASKPARM p) {
 }
 
 void taskRainGuage(PTASKPARM p) {
-    weather_packet_t *  pWeather;
+    uint32_t            tipCount;
 
-    pWeather = getWeatherPacket();
+    watchdogCheckIn(TASK_RAIN_GAUGE);
 
     /*
     ** Pulses are bitshifted into the RX_FIFO by the PIO.
@@ -217,11 +250,14 @@ void taskRainGuage(PTASKPARM p) {
     ** all we need to calculate the pulse count is 
     ** the number of entries in the FIFO x the bits per entry...
     */
-    pWeather->rawRainfall += 
-                (uint16_t)(pio_sm_get_rx_fifo_level(pio0, rainGaugeSM) * 
-                                        RAIN_GAUGE_PULSE_COUNT_BIT_SHIFT);
+    tipCount = pio_sm_get_rx_fifo_level(pio0, rainGaugeSM) * RAIN_GAUGE_PULSE_COUNT_BIT_SHIFT;
     
     pio_sm_clear_fifos(pio0, rainGaugeSM);
 
-//    lgLogDebug("Rainfall count: %d", (int)pWeather->rawRainfall);
+    if (tipCount > 0) {
+        rainAddTips(tipCount);
+        persistSaveScratch();
+    }
+
+//    lgLogDebug("Rainfall count: %d", (int)rainGetTotalTips());
 }
@@ -7,6 +7,7 @@
 
 void        pioInit(void);
 void        disablePIO(void);
+void        enablePIO(void);
 void        taskAnemometer(PTASKPARM p);
 void        taskRainGuage(PTASKPARM p);
 
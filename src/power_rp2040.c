@@ -0,0 +1,94 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/regs/m0plus.h"
+#include "hardware/structs/scb.h"
+#include "scheduler.h"
+#include "rtc_rp2040.h"
+#include "utils.h"
+#include "power_rp2040.h"
+
+/*
+** The clocks we keep running while asleep. The timer generates the
+** scheduler tick, the PIO counts the anemometer and rain gauge pulses,
+** IO_BANK0 and the pads detect GPIO edges and the watchdog must keep
+** counting. Everything else (I2C, SPI, ADC, PWM, USB, SRAM, XIP...) is
+** gated until the next interrupt wakes us...
+*/
+#define POWER_SLEEP_EN0                     (CLOCKS_SLEEP_EN0_CLK_SYS_PIO0_BITS | \
+                                             CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS | \
+                                             CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS | \
+                                             CLOCKS_SLEEP_EN0_CLK_SYS_BUSFABRIC_BITS | \
+                                             CLOCKS_SLEEP_EN0_CLK_SYS_SIO_BITS)
+
+#define POWER_SLEEP_EN1                     (CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS | \
+                                             CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS)
+
+/*
+** Keep the debug UART running so log output isn't cut off...
+*/
+#define POWER_SLEEP_EN1_DEBUG               (CLOCKS_SLEEP_EN1_CLK_SYS_UART0_BITS | \
+                                             CLOCKS_SLEEP_EN1_CLK_PERI_UART0_BITS)
+
+/*
+** Called by the scheduler on core 0, with interrupts disabled, when there
+** is nothing to run. Sleeps with the unused clocks gated and, if nothing is 
+** due for a while, stretches the tick so we sleep straight through to the 
+** next task...
+*/
+void powerIdle(rtc_t ticksToNext) {
+    uint32_t            sleepTicks;
+    uint32_t            scr;
+
+    if (ticksToNext > POWER_MAX_SLEEP_TICKS) {
+        sleepTicks = POWER_MAX_SLEEP_TICKS;
+    }
+    else {
+        sleepTicks = (uint32_t)ticksToNext;
+    }
+
+    if (isDebugActive()) {
+        /*
+        ** Keep a regular tick when debugging...
+        */
+        sleepTicks = 1;
+
+        clocks_hw->sleep_en1 = POWER_SLEEP_EN1 | POWER_SLEEP_EN1_DEBUG;
+    }
+    else {
+        clocks_hw->sleep_en1 = POWER_SLEEP_EN1;
+    }
+
+    clocks_hw->sleep_en0 = POWER_SLEEP_EN0;
+
+    rtcStretchTick(sleepTicks);
+
+    scr = scb_hw->scr;
+    scb_hw->scr = scr | M0PLUS_SCR_SLEEPDEEP_BITS;
+
+    /*
+    ** Sleep until the next interrupt, the clocks are re-enabled by 
+    ** the hardware as we wake...
+    */
+    __wfi();
+
+    scb_hw->scr = scr;
+
+    /*
+    ** Restore the reset defaults, so a plain __wfi() doesn't gate 
+    ** anything...
+    */
+    clocks_hw->sleep_en0 = 0xFFFFFFFF;
+    clocks_hw->sleep_en1 = 0xFFFFFFFF;
+
+    if (sleepTicks > 1) {
+        rtcResumeTick();
+    }
+}
+
+void powerInit(void) {
+    registerIdleTask(&powerIdle);
+}
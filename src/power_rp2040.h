@@ -0,0 +1,18 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+
+#ifndef __INCL_POWER_RP2040
+#define __INCL_POWER_RP2040
+
+/*
+** The longest we'll stretch the tick for when idle. A request posted
+** from core 1 to a task on core 0 can wait this long, so keep it short...
+*/
+#define POWER_MAX_SLEEP_TICKS               10
+
+void        powerInit(void);
+void        powerIdle(rtc_t ticksToNext);
+
+#endif
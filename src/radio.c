@@ -0,0 +1,193 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "hardware/sync.h"
+#include "scheduler.h"
+#include "taskdef.h"
+#include "rtc_rp2040.h"
+#include "nRF24L01.h"
+#include "radio.h"
+
+#define STATE_RADIO_POWER_UP                0x0100
+#define STATE_RADIO_SEND_PACKET             0x0200
+#define STATE_RADIO_WAIT_ACK                0x0210
+#define STATE_RADIO_FINISH                  0x0300
+
+typedef struct {
+    uint8_t                 buffer[RADIO_PACKET_LENGTH];
+    int                     length;
+    bool                    requestACK;
+    uint16_t                tag;
+}
+radio_packet_t;
+
+/*
+** The outgoing packet queue is written by the sensor task and read
+** by the radio task, which may be running on the other core. Each
+** index is only ever written by one side, so no locking is needed...
+*/
+static radio_packet_t       queue[RADIO_QUEUE_LENGTH];
+static volatile int         queueHead = 0;
+static volatile int         queueTail = 0;
+
+static volatile bool        isBusy = false;
+
+/*
+** The tags of the packets the base station ACKed since radioStart(), 
+** only written by the radio task...
+*/
+static uint16_t             ackedTags[RADIO_QUEUE_LENGTH];
+static int                  ackedCount = 0;
+
+static int _queuePacket(uint8_t * buf, int length, bool requestACK, uint16_t tag) {
+    int                     next;
+
+    if (length > RADIO_PACKET_LENGTH) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    next = (queueHead + 1) % RADIO_QUEUE_LENGTH;
+
+    if (next == queueTail) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    memset(queue[queueHead].buffer, 0, RADIO_PACKET_LENGTH);
+    memcpy(queue[queueHead].buffer, buf, length);
+    queue[queueHead].length = length;
+    queue[queueHead].requestACK = requestACK;
+    queue[queueHead].tag = tag;
+
+    __dmb();
+
+    queueHead = next;
+
+    return 0;
+}
+
+/*
+** Queue a packet to be sent without an ACK...
+*/
+int radioQueuePacket(uint8_t * buf, int length) {
+    return _queuePacket(buf, length, false, 0);
+}
+
+/*
+** Queue a packet the base station must ACK. Once the radio has finished,
+** radioGetAckedTags() returns the tag of each packet that was ACKed...
+*/
+int radioQueueAckPacket(uint8_t * buf, int length, uint16_t tag) {
+    return _queuePacket(buf, length, true, tag);
+}
+
+int radioGetQueueSpace(void) {
+    return (RADIO_QUEUE_LENGTH - 1) - ((queueHead - queueTail + RADIO_QUEUE_LENGTH) % RADIO_QUEUE_LENGTH);
+}
+
+/*
+** Copy out the tags of the packets ACKed in the last send, only valid
+** once radioIsBusy() returns false...
+*/
+int radioGetAckedTags(uint16_t * tags, int maxCount) {
+    int                     i;
+
+    for (i = 0;i < ackedCount && i < maxCount;i++) {
+        tags[i] = ackedTags[i];
+    }
+
+    return i;
+}
+
+/*
+** Start sending the queued packets, the radio must have been setup
+** with nRF24L01_setup() first...
+*/
+void radioStart(void) {
+    ackedCount = 0;
+    isBusy = true;
+
+    scheduleTask(TASK_RADIO, RUN_NOW, false, NULL);
+}
+
+bool radioIsBusy(void) {
+    return isBusy;
+}
+
+void taskRadio(PTASKPARM p) {
+    static int              state = STATE_RADIO_POWER_UP;
+    radio_packet_t *        pPacket;
+    rtc_t                   delay = 0;
+
+    switch (state) {
+        case STATE_RADIO_POWER_UP:
+            nRF24L01_powerUpTx(spi0);
+
+            state = STATE_RADIO_SEND_PACKET;
+            delay = rtc_val_ms(400);
+            break;
+
+        case STATE_RADIO_SEND_PACKET:
+            if (queueTail != queueHead) {
+                pPacket = &queue[queueTail];
+
+                nRF24L01_transmit_buffer(spi0, pPacket->buffer, pPacket->length, pPacket->requestACK);
+
+                /*
+                ** The retries are over well within a tick...
+                */
+                if (pPacket->requestACK) {
+                    state = STATE_RADIO_WAIT_ACK;
+                    delay = rtc_val_ms(100);
+                    break;
+                }
+
+                queueTail = (queueTail + 1) % RADIO_QUEUE_LENGTH;
+            }
+
+            if (queueTail != queueHead) {
+                delay = rtc_val_ms(100);
+            }
+            else {
+                state = STATE_RADIO_FINISH;
+                delay = rtc_val_ms(400);
+            }
+            break;
+
+        case STATE_RADIO_WAIT_ACK:
+            pPacket = &queue[queueTail];
+
+            if (nRF24L01_get_tx_result(spi0) == 0 && ackedCount < RADIO_QUEUE_LENGTH) {
+                ackedTags[ackedCount++] = pPacket->tag;
+            }
+
+            queueTail = (queueTail + 1) % RADIO_QUEUE_LENGTH;
+
+            if (queueTail != queueHead) {
+                state = STATE_RADIO_SEND_PACKET;
+                delay = RUN_NOW;
+            }
+            else {
+                state = STATE_RADIO_FINISH;
+                delay = rtc_val_ms(400);
+            }
+            break;
+
+        case STATE_RADIO_FINISH:
+            nRF24L01_powerDown(spi0);
+
+            state = STATE_RADIO_POWER_UP;
+
+            /*
+            ** The ACK results must be visible before we say we're done,
+            ** the caller may be on the other core...
+            */
+            __dmb();
+            isBusy = false;
+            return;
+    }
+
+    scheduleTask(TASK_RADIO, delay, false, NULL);
+}
@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scheduler.h"
+
+#ifndef __INCL_RADIO
+#define __INCL_RADIO
+
+#define RADIO_PACKET_LENGTH                 32
+
+/*
+** The queue holds RADIO_QUEUE_LENGTH - 1 packets, see radioGetQueueSpace()...
+*/
+#define RADIO_QUEUE_LENGTH                   4
+
+int         radioQueuePacket(uint8_t * buf, int length);
+int         radioQueueAckPacket(uint8_t * buf, int length, uint16_t tag);
+int         radioGetQueueSpace(void);
+int         radioGetAckedTags(uint16_t * tags, int maxCount);
+void        radioStart(void);
+bool        radioIsBusy(void);
+void        taskRadio(PTASKPARM p);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "rtc_rp2040.h"
+#include "rain.h"
+
+/*
+** Each bin holds the number of bucket tips recorded in one minute,
+** indexed by the scheduler minute modulo RAIN_BIN_COUNT. The total
+** tip count is never reset, so the base station can reconstruct the
+** rainfall across any packets it has missed by differencing the
+** (wrapping) counter in successive packets...
+*/
+static uint16_t             rainBins[RAIN_BIN_COUNT];
+static rtc_t                currentMinute = 0;
+static uint32_t             totalTips = 0;
+
+static rtc_t _getMinute(void) {
+    return (getRTCClock() / RTC_ONE_MINUTE);
+}
+
+/*
+** Move the current bin on to the minute supplied, clearing any bins
+** for the minutes we've skipped over...
+*/
+static void _advanceBins(rtc_t minute) {
+    rtc_t               m;
+
+    if (minute <= currentMinute) {
+        return;
+    }
+
+    if ((minute - currentMinute) >= RAIN_BIN_COUNT) {
+        memset(rainBins, 0, sizeof(rainBins));
+    }
+    else {
+        for (m = currentMinute + 1;m <= minute;m++) {
+            rainBins[m % RAIN_BIN_COUNT] = 0;
+        }
+    }
+
+    currentMinute = minute;
+}
+
+void rainAddTips(uint32_t tipCount) {
+    uint16_t *          bin;
+
+    _advanceBins(_getMinute());
+
+    bin = &rainBins[currentMinute % RAIN_BIN_COUNT];
+
+    if (((uint32_t)*bin + tipCount) > UINT16_MAX) {
+        *bin = UINT16_MAX;
+    }
+    else {
+        *bin += (uint16_t)tipCount;
+    }
+
+    totalTips += tipCount;
+}
+
+/*
+** Carry the total on from before a reset...
+*/
+void rainSetTotalTips(uint32_t tipCount) {
+    totalTips = tipCount;
+}
+
+/*
+** The total number of tips counted, this only ever increases...
+*/
+uint32_t rainGetTotalTips(void) {
+    return totalTips;
+}
+
+/*
+** The number of tips counted in the last hour...
+*/
+uint16_t rainGetLastHourTips(void) {
+    int                 i;
+    uint32_t            total = 0;
+
+    _advanceBins(_getMinute());
+
+    for (i = 0;i < RAIN_BIN_COUNT;i++) {
+        total += rainBins[i];
+    }
+
+    return (total > UINT16_MAX ? UINT16_MAX : (uint16_t)total);
+}
+
+/*
+** The maximum rain rate in the last hour in tips/hour, e.g. the
+** busiest minute scaled up to an hour. Multiply by RAIN_MM_PER_TIP
+** to get the intensity in mm/h...
+*/
+uint16_t rainGetMaxRate(void) {
+    int                 i;
+    uint32_t            maxTips = 0;
+
+    _advanceBins(_getMinute());
+
+    for (i = 0;i < RAIN_BIN_COUNT;i++) {
+        if (rainBins[i] > maxTips) {
+            maxTips = rainBins[i];
+        }
+    }
+
+    maxTips *= 60;
+
+    return (maxTips > UINT16_MAX ? UINT16_MAX : (uint16_t)maxTips);
+}
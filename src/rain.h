@@ -0,0 +1,24 @@
+#include <stdint.h>
+
+#include "scheduler.h"
+
+#ifndef __INCL_RAIN
+#define __INCL_RAIN
+
+/*
+** Rain gauge bucket size, each tip of the bucket is 0.2794mm of rain...
+*/
+#define RAIN_MM_PER_TIP                     0.2794f
+
+/*
+** We keep 1 hour of per-minute bins...
+*/
+#define RAIN_BIN_COUNT                      60
+
+void        rainAddTips(uint32_t tipCount);
+void        rainSetTotalTips(uint32_t tipCount);
+uint32_t    rainGetTotalTips(void);
+uint16_t    rainGetLastHourTips(void);
+uint16_t    rainGetMaxRate(void);
+
+#endif
@@ -16,6 +16,7 @@
 
 static double               _rtcFrequency = (double)RTC_CLOCK_FREQ;
 static volatile uint32_t    _rtcInterruptCycle = RTC_DEFAULT_INTERRUPT_CYCLE;
+static volatile uint32_t    _tickTime = 0;
 
 datetime_t * _fillDateTime(datetime_t * dt) {
     dt->day         = DATE_TIME_DAY;
@@ -42,14 +43,44 @@ void rtcDelay(uint32_t delay_us) {
     }
 }
 
+/*
+** The alarm only fires when the timer matches it exactly, so if we set it
+** to a time that has already passed it won't fire for another 71 minutes.
+** Push it on to the following tick if we're too close...
+*/
+static void _setAlarm(uint32_t alarmTime) {
+    if ((int32_t)(alarmTime - timer_hw->timerawl) < RTC_MIN_ALARM_US) {
+        alarmTime += _rtcInterruptCycle;
+    }
+
+    timer_hw->alarm[ALARM_NUM] = alarmTime;
+}
+
+/*
+** Ticks are counted from when they were due rather than when the
+** interrupt ran, so the tick doesn't drift and any ticks we've slept 
+** through are passed on to the scheduler...
+*/
+static void _catchUpTicks(void) {
+    uint32_t            ticks;
+
+    ticks = (timer_hw->timerawl - _tickTime) / _rtcInterruptCycle;
+
+    if (ticks > 0) {
+        _tickTime += ticks * _rtcInterruptCycle;
+        _rtcISRTicks(ticks);
+    }
+
+    _setAlarm(_tickTime + _rtcInterruptCycle);
+}
+
 static void irqTick(void) {
     // Clear the alarm irq
     hw_clear_bits(&timer_hw->intr, 1u << ALARM_NUM);
 
-	_rtcISR();
+    _catchUpTicks();
 
     hw_set_bits(&timer_hw->inte, 1u << ALARM_NUM);
-    timer_hw->alarm[ALARM_NUM] = (uint32_t)(timer_hw->timerawl + _rtcInterruptCycle);
 }
 
 void setupRTC(void) {
@@ -58,7 +89,27 @@ void setupRTC(void) {
     irq_set_exclusive_handler(TIMER_IRQ_0, irqTick);
     irq_set_enabled(ALARM_IRQ, true);
 
-    timer_hw->alarm[ALARM_NUM] = (uint32_t)(timer_hw->timerawl + _rtcInterruptCycle);
+    _tickTime = timer_hw->timerawl;
+    _setAlarm(_tickTime + _rtcInterruptCycle);
+}
+
+/*
+** Set the next tick interrupt for the number of ticks ahead, so we can
+** sleep through ticks where there is nothing to do. Must be called with
+** interrupts disabled and followed by rtcResumeTick() when we wake...
+*/
+void rtcStretchTick(uint32_t ticks) {
+    if (ticks > 1) {
+        _setAlarm(_tickTime + (ticks * _rtcInterruptCycle));
+    }
+}
+
+/*
+** Catch up with the ticks we slept through, we may have been woken early
+** by another interrupt, and go back to a tick every cycle...
+*/
+void rtcResumeTick(void) {
+    _catchUpTicks();
 }
 
 void disableRTC(void) {
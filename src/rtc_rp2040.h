@@ -9,8 +9,15 @@
 #define RTC_CLOCK_FREQ					10
 #define RTC_DEFAULT_INTERRUPT_CYCLE     100000U
 
+/*
+** Min time ahead (us) we can safely set the alarm...
+*/
+#define RTC_MIN_ALARM_US                20
+
 void		setupRTC(void);
 void        disableRTC(void);
+void        rtcStretchTick(uint32_t ticks);
+void        rtcResumeTick(void);
 void        rtcDelay(uint32_t delay_us);
 double      getRTCFrequency(void);
 void        setRTCFrequency(double frequency);
@@ -22,6 +29,12 @@ void        setRTCFrequency(double frequency);
 */
 #define rtc_val_ms(time_in_ms)				(rtc_t)((double)(time_in_ms) * ((double)RTC_CLOCK_FREQ / (double)1000))
 
+/*
+** The smallest number of ticks that covers time_in_ms, e.g. for waiting
+** on a conversion that must have finished...
+*/
+#define rtc_val_ms_min(time_in_ms)			(rtc_t)(((time_in_ms) * RTC_CLOCK_FREQ + 999) / 1000)
+
 #define rtc_val_sec(time_in_sec)			rtc_val_ms(time_in_sec * 1000)
 #define rtc_val_min(time_in_min)			rtc_val_sec(time_in_min * 60)
 #define rtc_val_hr(time_in_hr)				rtc_val_min(time_in_hr * 60)
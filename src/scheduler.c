@@ -11,54 +11,98 @@
 
 //#define PICO_MULTICORE
 
+/*
+** clock_gettime() & CLOCK_MONOTONIC for the host build...
+*/
+#ifdef UNIT_TEST_MODE
+#define _POSIX_C_SOURCE			199309L
+#endif
+
 #include <stddef.h>
-#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 
 #ifdef UNIT_TEST_MODE
 #include <stdio.h>
-#include <unistd.h>
-#endif
-
+#include <time.h>
+#else
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "hardware/uart.h"
 #include "hardware/gpio.h"
 #include "hardware/clocks.h"
 #include "hardware/regs/m0plus.h"
 #include "hardware/structs/sio.h"
 #include "hardware/structs/scb.h"
+#endif
 
 #include "scheduler.h"
 #include "schederr.h"
-#include "gpio_def.h"
+
+#ifdef UNIT_TEST_MODE
+#ifdef PICO_MULTICORE
+#error "PICO_MULTICORE is not supported in UNIT_TEST_MODE"
+#endif
+
+/*
+** Host shims so the scheduler builds and runs on a Linux box for
+** benchmarking. There is no tick interrupt on the host, so idling
+** simply advances the RTC by one tick, e.g. the scheduler runs in
+** simulated time as fast as the host can go...
+*/
+static uint32_t time_us_32(void)
+{
+	struct timespec		ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)(ts.tv_nsec / 1000L));
+}
+
+#define __wfi()						_rtcISR()
+
+#define save_and_disable_interrupts()	(0)
+#define restore_interrupts(status)		((void)(status))
+#endif
+
+/*
+** Tasks are linked by an 8-bit index and cross-core messages carry a 6-bit
+** task index...
+*/
+#if SCHED_MAX_TASKS > 64
+#error "SCHED_MAX_TASKS must not be greater than 64"
+#endif
 
 #ifndef UNIT_TEST_MODE
 /******************************************************************************
 **
 ** The TASKDESC struct.
 **
-** Holds the per-task info for the scheduler.
+** Holds the per-task info for the scheduler. Ordered largest field first
+** with the flags packed into a bitfield to keep the task table small.
 **
 ******************************************************************************/
 typedef struct
 {
-	uint16_t		ID;					// Unique user-assigned ID
-	rtc_t			startTime;			// The RTC value when scheduleTask() was callled
 	rtc_t			scheduledTime;		// The RTC value when the task should run
-	rtc_t			delay;				// The requested delay (in ms) of when the task should run
-	uint8_t			isScheduled;		// Is this task scheduled
-	uint8_t			isAllocated;		// Is this allocated to a task
-	uint8_t			isPeriodic;			// Should this task run repeatdly at the specified delay
+	uint32_t		delay;				// The requested delay (in RTC ticks) of when the task should run
 	PTASKPARM		pParameter;			// The parameters to the task
 
 	void (* run)(PTASKPARM);			// Pointer to the task function to run
-										// Must be of the form void task(uint8_t core, PTASKPARM p);
-	void * 			next;
-	void *			prev;
+										// Must be of the form void task(PTASKPARM p);
+	uint16_t		ID;					// Unique user-assigned ID
+	uint16_t		missedCount;		// Number of periods missed by a periodic task
+	uint8_t			next;				// Index of the next task in the registered queue
+	uint8_t			prev;				// Index of the previous task in the registered queue
+	uint8_t			isScheduled : 1;	// Is this task scheduled
+	uint8_t			isAllocated : 1;	// Is this allocated to a task
+	uint8_t			isPeriodic : 1;		// Should this task run repeatdly at the specified delay
+	uint8_t			coreID : 1;			// The core this task runs on
+	uint8_t			priority : 3;		// Task priority 0 (highest) to 5 (lowest)
+	uint8_t			isSuspended : 1;	// Is this task suspended, it keeps its schedule but won't run
 }
 TASKDESC;
 
@@ -93,39 +137,169 @@ void _nullTickTask()
 	// Do nothing...
 }
 
-static PTASKDESC			taskDescs;				// Array of tasks for the scheduler, allocated in initScheduler()
-static int					taskArrayLength;		// Length of the task array, e.g. num tasks allocated
+/******************************************************************************
+**
+** Name: _nullTraceTask()
+**
+** Description: Null trace task.
+**
+** Parameters:	N/A
+**
+** Returns:		void 
+**
+******************************************************************************/
+void _nullTraceTask(uint16_t taskID, uint8_t core, uint32_t runTime)
+{
+	// Do nothing...
+}
+
+static TASKDESC				taskDescs[SCHED_MAX_TASKS];	// Array of tasks for the scheduler
+static int					taskArrayLength;		// Number of tasks in use, set in initScheduler()
 
 static int					taskCount = 0;			// Number of tasks registered
 
 static PTASKDESC			head = NULL;			// Pointer to the beginning of the registered task queue
 static PTASKDESC			tail = NULL;			// Pointer to the end of the registered task queue
 
+/*
+** The registered task queue is linked by index into taskDescs[] rather
+** than by pointer, to keep the task descriptor small...
+*/
+#define _taskAt(index)				(&taskDescs[(index)])
+#define _indexOf(td)				((uint8_t)((td) - taskDescs))
+
+#ifdef PICO_MULTICORE
+static uint32_t				_tasksRunCount[2] = {0, 0};	// The total number of tasks run on each core
+#else
 static uint32_t				_tasksRunCount = 0;		// The total number of tasks run by the scheduler
+#endif
 
 static volatile rtc_t 	    _realTimeClock = 0;		// The real time clock counter
 static volatile uint16_t	_tickCount = 0;			// Num ticks between rtc counts
 
+static volatile uint32_t	_lastTickTime = 0;		// The us timer value at the last tick
+static volatile uint32_t	_tickPeriod = 0;		// The measured tick period in us
+
+static TASK_LATENCY			_latency[TASK_NUM_PRIORITIES];	// Dispatch latency per priority
+
+static uint32_t				_missedPeriodCount = 0;	// Total periods missed by periodic tasks
+
+/*
+** Tasks signalled with signalTask(), one bit per entry in taskDescs[]. This
+** is set from interrupt handlers, so is only ever changed with interrupts
+** disabled (and holding the spin lock when both cores are running)...
+*/
+static volatile uint64_t	_signalPending = 0;
+
+#define _signalBit(td)				((uint64_t)1 << _indexOf(td))
+
+#ifdef PICO_MULTICORE
+static spin_lock_t *		_signalLock = NULL;
+
+#define _lockSignals()				spin_lock_blocking(_signalLock)
+#define _unlockSignals(status)		spin_unlock(_signalLock, status)
+#else
+#define _lockSignals()				save_and_disable_interrupts()
+#define _unlockSignals(status)		restore_interrupts(status)
+#endif
+
+static uint32_t				_latencyHistogram[SCHED_LATENCY_BUCKETS];	// Dispatch latency, log2(us) buckets
+
+static uint32_t				_idleCount = 0;			// Number of times the scheduler has idled
+static uint32_t				_idleTime = 0;			// Time spent idle (us) since getCPURatio()
+static uint32_t				_busyTime = 0;			// Time spent running tasks (us) since getCPURatio()
+
 // The RTC tick task...
 void 						(* _tickTask)() = &_nullTickTask;
 
+// The trace task, called before & after each task runs...
+static void					(* _traceTask)(uint16_t, uint8_t, uint32_t) = &_nullTraceTask;
+
+// The idle task, called on core 0 when there is nothing to run...
+static void					(* _idleTask)(rtc_t) = NULL;
+
+#ifdef PICO_MULTICORE
+/*
+** Cross-core requests are passed as single 32-bit words through the
+** SIO FIFOs, which are hardware single-producer/single-consumer queues
+** (one in each direction), so no locks are needed. The core that owns
+** a task is the only core that ever changes its schedule:
+**
+** Bits 31 - 29		Message type
+** Bit  28			Is periodic
+** Bits 27 - 22		Task index in the task array
+** Bits 21 - 0		Delay in RTC ticks
+*/
+#define SCHED_MSG_SCHEDULE			0x01
+#define SCHED_MSG_RESCHEDULE		0x02
+#define SCHED_MSG_UNSCHEDULE		0x03
+#define SCHED_MSG_SUSPEND			0x04
+#define SCHED_MSG_RESUME			0x05
+
+#define SCHED_MSG_TYPE_SHIFT		29
+#define SCHED_MSG_PERIODIC_BIT		0x10000000
+#define SCHED_MSG_INDEX_SHIFT		22
+#define SCHED_MSG_INDEX_MASK		0x3F
+#define SCHED_MSG_MAX_DELAY			0x003FFFFF
+
+/*
+** Core 1 parks itself in RAM while core 0 writes to the flash, see
+** lockoutOtherCore(). We can't use the SDK multicore lockout, it takes
+** over the SIO FIFO we use for the messages above...
+*/
+static volatile bool		_isCore1Running = false;
+static volatile bool		_isLockoutRequested = false;
+static volatile bool		_isCore1Parked = false;
+
+static rtc_t _getRTCClockCount(void);
+
+/*
+** The RTC is updated by the ISR on core 0, on core 1 a 64-bit read
+** can be torn so read it until we get a consistent value...
+*/
+#define getRTCClockCount()	_getRTCClockCount()
+
+#define _isLocalTask(td, core)		((td)->coreID == (core))
+#else
 #define getRTCClockCount()	(_realTimeClock)
 
+#define _isLocalTask(td, core)		(1)
+#endif
+
 extern void _sleepPowerDown();
 
 /******************************************************************************
 **
-** Name: _rtcISR()
+** Name: _rtcISRTicks()
 **
-** Description: The RTC interrupt handler.
+** Description: The RTC interrupt handler, for when one or more ticks have
+** elapsed since the last interrupt, e.g. when the tick has been stretched
+** to sleep through ticks where nothing is due to run.
 **
-** Parameters:	N/A
+** Parameters:	uint32_t	ticks		The number of ticks elapsed
 **
 ** Returns:		void 
 **
 ******************************************************************************/
-void _rtcISR() {
-	_realTimeClock++;
+void _rtcISRTicks(uint32_t ticks) {
+	uint32_t		now = time_us_32();
+
+	_realTimeClock += ticks;
+
+	/*
+	** Only measure the tick period from consecutive ticks...
+	*/
+	if (_lastTickTime != 0 && ticks == 1) {
+		_tickPeriod = now - _lastTickTime;
+	}
+	_lastTickTime = now;
+
+#ifdef PICO_MULTICORE
+	/*
+	** Wake core 1 from __wfe() so it can check its tasks...
+	*/
+	__sev();
+#endif
 
 #ifdef SCHED_ENABLE_TICK_TASK
 	/*
@@ -134,10 +308,27 @@ void _rtcISR() {
 	 * This must be a very fast operation, as it is outside of
 	 * the scheduler's control. Also, there can be only 1 tick task...
 	 */
-	_tickTask();
+	while (ticks--) {
+		_tickTask();
+	}
 #endif
 }
 
+/******************************************************************************
+**
+** Name: _rtcISR()
+**
+** Description: The RTC interrupt handler.
+**
+** Parameters:	N/A
+**
+** Returns:		void 
+**
+******************************************************************************/
+void _rtcISR() {
+	_rtcISRTicks(1);
+}
+
 /******************************************************************************
 **
 ** Name: _getScheduledTime()
@@ -199,12 +390,652 @@ static PTASKDESC _findTaskByID(uint16_t taskID)
 	for (i = 0;i < taskArrayLength;i++) {
 		td = &taskDescs[i];
 		
-		if (td->ID == taskID) {
+		if (td->isAllocated && td->ID == taskID) {
+			return td;
+		}
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+**
+** Name: _unlinkTask()
+**
+** Description: Removes the task from the registered task queue.
+**
+** Parameters:
+**				PTASKDESC	td				The task to unlink
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _unlinkTask(PTASKDESC td)
+{
+	if (_taskAt(td->next) == td) {
+		/*
+		** This is the only task...
+		*/
+		head = tail = NULL;
+	}
+	else {
+		_taskAt(td->prev)->next = td->next;
+		_taskAt(td->next)->prev = td->prev;
+
+		if (td == head) {
+			head = _taskAt(td->next);
+		}
+		if (td == tail) {
+			tail = _taskAt(td->prev);
+		}
+	}
+
+	td->next = _indexOf(td);
+	td->prev = _indexOf(td);
+}
+
+/******************************************************************************
+**
+** Name: _linkTask()
+**
+** Description: Inserts the task into the registered task queue, which is
+** kept in priority order. A task goes after any existing tasks of the same
+** priority, so equal priority tasks run in the order they were registered.
+**
+** Parameters:
+**				PTASKDESC	td				The task to link
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _linkTask(PTASKDESC td)
+{
+	PTASKDESC	before;
+
+	if (head == NULL) {
+		/*
+		** This must be the first task, point its next & prev 
+		** links to itself...
+		*/
+		head = tail = td;
+
+		td->next = _indexOf(td);
+		td->prev = _indexOf(td);
+		return;
+	}
+
+	/*
+	** Find the first task with a lower priority than ours...
+	*/
+	before = head;
+
+	do {
+		if (before->priority > td->priority) {
 			break;
 		}
+
+		before = _taskAt(before->next);
+	}
+	while (before != head);
+
+	td->next = _indexOf(before);
+	td->prev = before->prev;
+	_taskAt(before->prev)->next = _indexOf(td);
+	before->prev = _indexOf(td);
+
+	if (before == head && head->priority > td->priority) {
+		head = td;
+	}
+	else if (before == head) {
+		tail = td;
+	}
+}
+
+/******************************************************************************
+**
+** Name: _recordLatency()
+**
+** Description: Records the dispatch latency for a task that is just about 
+** to run, e.g. the time since the tick on which it became due.
+**
+** Parameters:
+**				PTASKDESC	td				The task about to run
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _recordLatency(PTASKDESC td)
+{
+	PTASK_LATENCY	l;
+	uint32_t		latency;
+	int				bucket;
+
+	if (td->delay == 0) {
+		return;
+	}
+
+	latency = 	(uint32_t)(getRTCClockCount() - td->scheduledTime) * _tickPeriod + 
+				(time_us_32() - _lastTickTime);
+
+	l = &_latency[td->priority];
+
+	l->runCount++;
+	l->totalLatency += latency;
+
+	if (latency > l->maxLatency) {
+		l->maxLatency = latency;
+	}
+
+	/*
+	** Bucket n holds latencies from 2^(n-1) to (2^n)-1 us, bucket 0
+	** is a latency of 0us and the last bucket catches everything 
+	** above the range...
+	*/
+	bucket = 0;
+
+	while (latency > 0 && bucket < (SCHED_LATENCY_BUCKETS - 1)) {
+		latency >>= 1;
+		bucket++;
+	}
+
+	_latencyHistogram[bucket]++;
+}
+
+/******************************************************************************
+**
+** Name: _scheduleLocalTask(), _rescheduleLocalTask(), _unscheduleLocalTask()
+**
+** Description: Update the schedule of a task owned by the calling core.
+**
+******************************************************************************/
+static void _scheduleLocalTask(PTASKDESC td, rtc_t time, bool isPeriodic)
+{
+	/*
+	** The delay is held in 32-bits, which at 100ms per tick is over
+	** 13 years, so clamping it here is safe...
+	*/
+	td->delay = (time > UINT32_MAX ? UINT32_MAX : (uint32_t)time);
+	td->scheduledTime = _getScheduledTime(getRTCClockCount(), td->delay);
+	td->isScheduled = 1;
+	td->isPeriodic = isPeriodic;
+}
+
+static void _rescheduleLocalTask(PTASKDESC td)
+{
+	td->scheduledTime = _getScheduledTime(getRTCClockCount(), td->delay);
+	td->isScheduled = 1;
+}
+
+static void _unscheduleLocalTask(PTASKDESC td)
+{
+	td->scheduledTime = 0;
+	td->isScheduled = 0;
+}
+
+/******************************************************************************
+**
+** Name: _advancePeriodicTask()
+**
+** Description: Schedules the next run of a periodic task relative to when
+** it was due to run, rather than when it actually ran, so the task does not
+** drift by its execution time and dispatch latency every period. If we are
+** a few periods late the task is left due, so the late runs catch up 
+** back-to-back, e.g. a task that counts its runs to time a window still
+** gets the right number of runs. Beyond SCHED_MAX_CATCH_UP_PERIODS the
+** missed periods are skipped and counted instead.
+**
+** Parameters:
+**				PTASKDESC	td				The periodic task
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _advancePeriodicTask(PTASKDESC td)
+{
+	rtc_t		now;
+	rtc_t		missed;
+
+	if (td->delay == 0) {
+		_rescheduleLocalTask(td);
+		return;
+	}
+
+	now = getRTCClockCount();
+
+	td->scheduledTime = _getScheduledTime(td->scheduledTime, td->delay);
+
+	if (td->scheduledTime < now) {
+		missed = (now - td->scheduledTime + td->delay - 1) / td->delay;
+
+		if (missed <= SCHED_MAX_CATCH_UP_PERIODS) {
+			td->isScheduled = 1;
+			return;
+		}
+
+		td->scheduledTime += missed * td->delay;
+
+		if (((uint32_t)td->missedCount + missed) > UINT16_MAX) {
+			td->missedCount = UINT16_MAX;
+		}
+		else {
+			td->missedCount += (uint16_t)missed;
+		}
+
+		_missedPeriodCount += (uint32_t)missed;
 	}
 
-	return td;
+	td->isScheduled = 1;
+}
+
+#ifdef PICO_MULTICORE
+static rtc_t _getRTCClockCount(void)
+{
+	rtc_t		t1;
+	rtc_t		t2;
+
+	do {
+		t1 = _realTimeClock;
+		t2 = _realTimeClock;
+	}
+	while (t1 != t2);
+
+	return t1;
+}
+
+/******************************************************************************
+**
+** Name: _processMessages()
+**
+** Description: Applies any requests posted to this core by the other core.
+**
+** Parameters:	N/A
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _processMessages(void)
+{
+	uint32_t	msg;
+	PTASKDESC	td;
+
+	while (multicore_fifo_rvalid()) {
+		msg = multicore_fifo_pop_blocking();
+
+		td = &taskDescs[(msg >> SCHED_MSG_INDEX_SHIFT) & SCHED_MSG_INDEX_MASK];
+
+		switch (msg >> SCHED_MSG_TYPE_SHIFT) {
+			case SCHED_MSG_SCHEDULE:
+				_scheduleLocalTask(
+						td, 
+						(rtc_t)(msg & SCHED_MSG_MAX_DELAY), 
+						(msg & SCHED_MSG_PERIODIC_BIT) ? true : false);
+				break;
+
+			case SCHED_MSG_RESCHEDULE:
+				_rescheduleLocalTask(td);
+				break;
+
+			case SCHED_MSG_UNSCHEDULE:
+				_unscheduleLocalTask(td);
+				break;
+
+			case SCHED_MSG_SUSPEND:
+				td->isSuspended = 1;
+				break;
+
+			case SCHED_MSG_RESUME:
+				td->isSuspended = 0;
+				break;
+		}
+	}
+}
+
+/******************************************************************************
+**
+** Name: _postMessage()
+**
+** Description: Posts a request to the core that owns the task. If the
+** FIFO is full we drain our own incoming FIFO while we wait, so the two
+** cores can never deadlock waiting on each other.
+**
+** Parameters:	
+** uint8_t		type		The message type
+** PTASKDESC	td			The task the message is for
+** rtc_t		time		The delay in RTC ticks
+** bool			isPeriodic	Is the task periodic
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _postMessage(uint8_t type, PTASKDESC td, rtc_t time, bool isPeriodic)
+{
+	uint32_t	msg;
+
+	if (time > SCHED_MSG_MAX_DELAY) {
+		time = SCHED_MSG_MAX_DELAY;
+	}
+
+	msg = 	((uint32_t)type << SCHED_MSG_TYPE_SHIFT) | 
+			((uint32_t)(td - taskDescs) << SCHED_MSG_INDEX_SHIFT) | 
+			(uint32_t)time;
+
+	if (isPeriodic) {
+		msg |= SCHED_MSG_PERIODIC_BIT;
+	}
+
+	while (!multicore_fifo_wready()) {
+		_processMessages();
+	}
+
+	multicore_fifo_push_blocking(msg);
+}
+
+/******************************************************************************
+**
+** Name: _core1Entry()
+**
+** Description: Entry point for core 1, which simply runs its own
+** scheduler loop over the tasks with core 1 affinity.
+**
+******************************************************************************/
+static void _core1Entry(void)
+{
+	/*
+	** The chip only gates the clocks in sleep_en0/1 when both cores are
+	** asleep with SLEEPDEEP set. Core 1 only ever sleeps in _idle(), so
+	** it can be left set...
+	*/
+	scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+
+	_isCore1Running = true;
+
+	schedule();
+}
+
+/******************************************************************************
+**
+** Name: _parkCore1()
+**
+** Description: Spins in RAM with interrupts disabled until core 0 releases
+** the lockout, so core 1 does not touch the flash while it is being erased 
+** or programmed.
+**
+******************************************************************************/
+static void __not_in_flash_func(_parkCore1)(void)
+{
+	uint32_t		status;
+
+	status = save_and_disable_interrupts();
+
+	_isCore1Parked = true;
+	__dmb();
+
+	while (_isLockoutRequested) {
+		tight_loop_contents();
+	}
+
+	__dmb();
+	_isCore1Parked = false;
+
+	restore_interrupts(status);
+}
+
+static bool _isCore1Required(void)
+{
+	int			i;
+
+	for (i = 0;i < taskArrayLength;i++) {
+		if (taskDescs[i].isAllocated && taskDescs[i].coreID == 1) {
+			return true;
+		}
+	}
+
+	return false;
+}
+#endif
+
+/******************************************************************************
+**
+** Name: _clearSignal()
+**
+** Description: Clears a pending signal for the task, called just before
+** the task runs so a signal raised while it is running is not lost.
+**
+** Parameters:
+**				PTASKDESC	td				The task
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _clearSignal(PTASKDESC td)
+{
+	uint32_t		status;
+
+	status = _lockSignals();
+	_signalPending &= ~_signalBit(td);
+	_unlockSignals(status);
+}
+
+/******************************************************************************
+**
+** Name: _runNextDueTask()
+**
+** Description: Runs the highest priority task owned by the core that is
+** due to run or has been signalled, if there is one.
+**
+** Parameters:
+**				uint8_t		core			The core we're running on
+**
+** Returns:		true if a task was run, false if no tasks are due
+**
+******************************************************************************/
+static bool _runNextDueTask(uint8_t core)
+{
+	PTASKDESC		td = head;
+	uint32_t		startTime;
+	uint32_t		runTime;
+	bool			isDue;
+	bool			isSignalled;
+
+	if (td == NULL) {
+		return false;
+	}
+
+	do {
+		if (!_isLocalTask(td, core) || td->isSuspended) {
+			td = _taskAt(td->next);
+			continue;
+		}
+
+		isDue = (td->isScheduled && getRTCClockCount() >= td->scheduledTime);
+		isSignalled = ((_signalPending & _signalBit(td)) != 0);
+
+		if (isDue || isSignalled) {
+			if (isSignalled) {
+				_clearSignal(td);
+			}
+
+			if (isDue) {
+				/*
+				** Mark the task as un-scheduled, so by default the
+				** task will not run again automatically. If the task
+				** is periodic or if the task reschedules itself, this 
+				** flag will be reset to 1...
+				*/
+				td->isScheduled = 0;
+
+				_recordLatency(td);
+			}
+
+			/*
+			** Run the task...
+			*/
+			startTime = time_us_32();
+
+			_traceTask(td->ID, core, TRACE_TASK_START);
+
+			td->run(td->pParameter);
+
+			runTime = time_us_32() - startTime;
+
+			_traceTask(td->ID, core, runTime);
+
+			if (core == 0) {
+				_busyTime += runTime;
+			}
+
+			/*
+			** A signal does not disturb the schedule of a periodic
+			** task, it just runs the task an extra time...
+			*/
+			if (isDue && td->isPeriodic && !td->isScheduled) {
+				_advancePeriodicTask(td);
+			}
+
+#ifdef PICO_MULTICORE
+			_tasksRunCount[core]++;
+#else
+			_tasksRunCount++;
+#endif
+			return true;
+		}
+
+		td = _taskAt(td->next);
+	}
+	while (td != head);
+
+	return false;
+}
+
+/******************************************************************************
+**
+** Name: _getTicksToNextTask()
+**
+** Description: Gets the number of ticks until the next scheduled task on
+** either core is due to run.
+**
+** Parameters:	N/A
+**
+** Returns:		The number of ticks, 0 if a task is due now or 
+**				MAX_TIMER_VALUE if nothing is scheduled
+**
+******************************************************************************/
+static rtc_t _getTicksToNextTask(void)
+{
+	PTASKDESC		td = head;
+	rtc_t			now = getRTCClockCount();
+	rtc_t			ticksToNext = MAX_TIMER_VALUE;
+
+	if (td == NULL) {
+		return ticksToNext;
+	}
+
+	do {
+		if (td->isScheduled && !td->isSuspended) {
+			if (td->scheduledTime <= now) {
+				return 0;
+			}
+			else if ((td->scheduledTime - now) < ticksToNext) {
+				ticksToNext = td->scheduledTime - now;
+			}
+		}
+
+		td = _taskAt(td->next);
+	}
+	while (td != head);
+
+	return ticksToNext;
+}
+
+/******************************************************************************
+**
+** Name: _getRunnableSignalMask()
+**
+** Description: Gets the signal bits of the tasks the core can run now. A
+** signal to a task on the other core, or to a suspended task, stays
+** pending but must not keep this core awake.
+**
+** Parameters:
+**				uint8_t		core			The core we're running on
+**
+** Returns:		The mask of signal bits
+**
+******************************************************************************/
+static uint64_t _getRunnableSignalMask(uint8_t core)
+{
+	PTASKDESC		td = head;
+	uint64_t		mask = 0;
+
+	if (td == NULL) {
+		return mask;
+	}
+
+	do {
+		if (_isLocalTask(td, core) && !td->isSuspended) {
+			mask |= _signalBit(td);
+		}
+
+		td = _taskAt(td->next);
+	}
+	while (td != head);
+
+	return mask;
+}
+
+/******************************************************************************
+**
+** Name: _idle()
+**
+** Description: Sleeps until the next interrupt, recording the time spent
+** idle on core 0.
+**
+** Parameters:
+**				uint8_t		core			The core we're running on
+**
+** Returns:		void 
+**
+******************************************************************************/
+static void _idle(uint8_t core)
+{
+	uint32_t		startTime;
+	uint32_t		status;
+
+#ifdef PICO_MULTICORE
+	if (core == 1) {
+		/*
+		** Core 1 has no tick interrupt of its own, it is 
+		** woken by the __sev() in the RTC ISR on core 0, by
+		** signalTask() or when core 0 posts a message to the 
+		** FIFO. The event is latched, so nothing is missed...
+		*/
+		__wfe();
+		return;
+	}
+#endif
+
+	startTime = time_us_32();
+
+	/*
+	** An interrupt that signals a task after we've scanned the task
+	** list but before we sleep would leave the task waiting for the
+	** next tick. With interrupts disabled, __wfi() still wakes on a
+	** pending interrupt, so check for signals and sleep atomically...
+	*/
+	status = save_and_disable_interrupts();
+
+	if ((_signalPending & _getRunnableSignalMask(core)) == 0) {
+		if (_idleTask != NULL) {
+			_idleTask(_getTicksToNextTask());
+		}
+		else {
+			__wfi();
+		}
+	}
+
+	restore_interrupts(status);
+
+	_idleTime += time_us_32() - startTime;
+	_idleCount++;
 }
 
 #ifdef UNIT_TEST_MODE
@@ -213,6 +1044,11 @@ PTASKDESC getRegisteredTasks()
 	return head;
 }
 
+PTASKDESC getNextTask(PTASKDESC td)
+{
+	return _taskAt(td->next);
+}
+
 int isLastTask(PTASKDESC td)
 {
 	if (td == tail) {
@@ -222,43 +1058,172 @@ int isLastTask(PTASKDESC td)
 		return 0;
 	}
 }
-#endif
 
 /******************************************************************************
 **
-** Public API functions
+** Name: scheduleDueTasks()
+**
+** Description: Runs every task that is due at the current RTC count, in
+** priority order, without idling. Lets a host harness drive the scheduler
+** a tick at a time with _rtcISR() rather than calling schedule(), which
+** never returns.
+**
+** Parameters:	N/A
+**
+** Returns:		The number of tasks run
+**
+******************************************************************************/
+int scheduleDueTasks()
+{
+	int				runCount = 0;
+
+	while (_runNextDueTask(0)) {
+		runCount++;
+	}
+
+	return runCount;
+}
+#endif
+
+/******************************************************************************
+**
+** Public API functions
+**
+******************************************************************************/
+
+/******************************************************************************
+**
+** Name: getRTCClock()
+**
+** Description: Returns the current RTC clock value.
+**
+** Parameters:	None
+**
+** Returns:		rtc_t 
+**
+******************************************************************************/
+rtc_t getRTCClock(void) {
+    return getRTCClockCount();
+}
+
+/******************************************************************************
+**
+** Name: getTaskRunCount()
+**
+** Description: Gets the total number of tasks run by the scheduler, useful
+**				for a dashboard for example.
+**
+** Parameters:	None
+**
+** Returns:		uint32_t		The number of tasks run 
+**
+******************************************************************************/
+uint32_t getTaskRunCount() {
+#ifdef PICO_MULTICORE
+	return _tasksRunCount[0] + _tasksRunCount[1];
+#else
+	return _tasksRunCount;
+#endif
+}
+
+/******************************************************************************
+**
+** Name: getTaskLatency()
+**
+** Description: Gets the dispatch latency stats for tasks of the specified
+** priority.
+**
+** Parameters:	uint8_t			priority	The task priority
+**				PTASK_LATENCY	latency		Filled in with the stats
+**
+** Returns:		void 
+**
+******************************************************************************/
+void getTaskLatency(uint8_t priority, PTASK_LATENCY latency) {
+	if (priority > TASK_PRIORITY_LOWEST) {
+		priority = TASK_PRIORITY_LOWEST;
+	}
+
+	memcpy(latency, &_latency[priority], sizeof(TASK_LATENCY));
+}
+
+/******************************************************************************
+**
+** Name: getCPURatio()
+**
+** Description: Gets the time core 0 has spent running tasks and idle since
+** the last call, then starts a new measurement period.
+**
+** Parameters:	PCPU_RATIO		cpuRatio	Filled in with the busy/idle us
+**
+** Returns:		void 
 **
 ******************************************************************************/
+void getCPURatio(PCPU_RATIO cpuRatio) {
+	cpuRatio->busyCount = _busyTime;
+	cpuRatio->idleCount = _idleTime;
+
+	_busyTime = 0;
+	_idleTime = 0;
+}
 
 /******************************************************************************
 **
-** Name: getRTCClock()
+** Name: getSchedulerStats()
 **
-** Description: Returns the current RTC clock value.
+** Description: Gets the dispatch latency histogram, idle count and memory
+** used by the scheduler.
 **
-** Parameters:	None
+** Parameters:	PSCHED_STATS	stats		Filled in with the stats
 **
-** Returns:		rtc_t 
+** Returns:		void 
 **
 ******************************************************************************/
-rtc_t getRTCClock(void) {
-    return getRTCClockCount();
+void getSchedulerStats(PSCHED_STATS stats) {
+	memcpy(stats->latencyHistogram, _latencyHistogram, sizeof(_latencyHistogram));
+
+	stats->idleCount = _idleCount;
+	stats->taskCount = (uint32_t)taskCount;
+	stats->memoryUsed = (uint32_t)sizeof(taskDescs);
 }
 
 /******************************************************************************
 **
-** Name: getTaskRunCount()
+** Name: getTaskMissedPeriods()
 **
-** Description: Gets the total number of tasks run by the scheduler, useful
-**				for a dashboard for example.
+** Description: Gets the number of periods a periodic task has missed
+** because it overran.
+**
+** Parameters:	uint16_t	taskID		The unique ID for the task
+**
+** Returns:		uint16_t	The number of missed periods
+**
+******************************************************************************/
+uint16_t getTaskMissedPeriods(uint16_t taskID) {
+	PTASKDESC	td = NULL;
+
+	td = _findTaskByID(taskID);
+
+	if (td != NULL) {
+		return td->missedCount;
+	}
+
+	return 0;
+}
+
+/******************************************************************************
+**
+** Name: getMissedPeriodCount()
+**
+** Description: Gets the total number of periods missed by all periodic tasks.
 **
 ** Parameters:	None
 **
-** Returns:		uint32_t		The number of tasks run 
+** Returns:		uint32_t	The number of missed periods
 **
 ******************************************************************************/
-uint32_t getTaskRunCount() {
-	return _tasksRunCount;
+uint32_t getMissedPeriodCount() {
+	return _missedPeriodCount;
 }
 
 /******************************************************************************
@@ -268,7 +1233,7 @@ uint32_t getTaskRunCount() {
 ** Description: Initialises the scheduler, must be called before any other
 ** scheduler API functions.
 **
-** Parameters:	int		size		Size of the task array
+** Parameters:	int		size		Number of tasks to use, up to SCHED_MAX_TASKS
 **
 ** Returns:		void 
 **
@@ -278,10 +1243,10 @@ void initScheduler(int size) {
 	PTASKDESC	td = NULL;
 
 	if (size <= 0) {
-		taskArrayLength = DEFAULT_MAX_TASKS;
+		taskArrayLength = SCHED_MAX_TASKS;
 	}
-	else if (size > DEFAULT_MAX_TASKS) {
-		taskArrayLength = DEFAULT_MAX_TASKS;
+	else if (size > SCHED_MAX_TASKS) {
+		taskArrayLength = SCHED_MAX_TASKS;
 	}
 	else {
 		taskArrayLength = size;
@@ -291,32 +1256,43 @@ void initScheduler(int size) {
 printf("Allocated %d tasks\n", taskArrayLength);
 #endif
 
-	/*
-	** Allocate memory for task array...
-	*/
-	taskDescs = (PTASKDESC)malloc((taskArrayLength) * sizeof(TASKDESC));
+	taskCount = 0;
 
-	if (taskDescs == NULL) {
-		handleError(ERROR_SCHED_TASKCOUNTOVERFLOW);
-	}
+	head = NULL;
+	tail = NULL;
 
-	taskCount = 0;
+	memset(_latency, 0, sizeof(_latency));
+	memset(_latencyHistogram, 0, sizeof(_latencyHistogram));
+	_missedPeriodCount = 0;
+	_signalPending = 0;
+
+#ifdef PICO_MULTICORE
+	if (_signalLock == NULL) {
+		_signalLock = spin_lock_instance(spin_lock_claim_unused(true));
+	}
+#endif
+	_idleCount = 0;
+	_idleTime = 0;
+	_busyTime = 0;
 	
 	for (i = 0;i < (taskArrayLength);i++) {
 		td = &taskDescs[i];
 		
 		td->ID				= 0;
-		td->startTime		= 0;
 		td->scheduledTime	= 0;
 		td->delay			= 0;
 		td->isScheduled		= 0;
 		td->isAllocated		= 0;
 		td->isPeriodic		= 0;
+		td->priority		= TASK_PRIORITY_DEFAULT;
+		td->missedCount		= 0;
+		td->coreID			= 0;
+		td->isSuspended		= 0;
 		td->pParameter		= NULL;
 		td->run				= &_nullTask;
 
-		td->next			= NULL;
-		td->prev			= NULL;
+		td->next			= (uint8_t)i;
+		td->prev			= (uint8_t)i;
 	}
 }
 
@@ -336,6 +1312,68 @@ void registerTickTask(void (* tickTask)()) {
 	_tickTask = tickTask;
 }
 
+/******************************************************************************
+**
+** Name: registerIdleTask()
+**
+** Description: Registers a task to put core 0 to sleep when there is 
+** nothing to run, in place of the default __wfi(). It is called with 
+** interrupts disabled and must sleep until the next interrupt, e.g. by
+** calling __wfi() itself, it is passed the number of ticks until the next
+** scheduled task is due so it can choose how deeply to sleep.
+**
+** Parameters:	void 	(* idleTask)	Pointer to the idle task function
+**
+** Returns:		void 
+**
+******************************************************************************/
+void registerIdleTask(void (* idleTask)(rtc_t ticksToNext)) {
+	_idleTask = idleTask;
+}
+
+/******************************************************************************
+**
+** Name: registerTraceTask()
+**
+** Description: Registers a function to be called just before each task 
+** runs, with a runTime of TRACE_TASK_START, and again just after with the
+** time it ran for (us). Called on the core the task runs on, so it must be
+** short. Lets us see which task was running if we crash.
+**
+** Parameters:	void 	(* traceTask)	Pointer to the trace function
+**
+** Returns:		void 
+**
+******************************************************************************/
+void registerTraceTask(void (* traceTask)(uint16_t taskID, uint8_t core, uint32_t runTime)) {
+	_traceTask = traceTask;
+}
+
+#ifdef PICO_MULTICORE
+/******************************************************************************
+**
+** Name: setTaskAttributes()
+**
+** Description: Sets the core a registered task runs on. This must be called
+** before schedule() is called, tasks run on core 0 by default.
+**
+** Parameters:	uint16_t	taskID		The unique ID for the task
+**				bool		isCore0		true to run on core 0, false for core 1
+**
+** Returns:		void 
+**
+******************************************************************************/
+void setTaskAttributes(uint16_t taskID, bool isCore0) {
+	PTASKDESC	td = NULL;
+
+	td = _findTaskByID(taskID);
+
+	if (td != NULL) {
+		td->coreID = (isCore0 ? 0 : 1);
+	}
+}
+#endif
+
 /******************************************************************************
 **
 ** Name: registerTask()
@@ -359,32 +1397,13 @@ void registerTask(uint16_t taskID, void (* run)(PTASKPARM)) {
 		if (!td->isAllocated) {
 			td->ID = taskID;
 			td->isAllocated = 1;
+			td->priority = TASK_PRIORITY_DEFAULT;
 			td->run = run;
 
 			taskCount++;
 			noFreeTasks = 0;
 
-			if (tail != NULL) {
-				/*
-				** Insert our task here (at the end of the queue)...
-				*/
-				td->prev = tail;
-				td->next = head;
-				tail->next = td;
-				tail = td;
-			}
-			else {
-				/*
-				** This must be the first task...
-				*/
-				head = tail = td;
-
-				/*
-				** Point its next & prev ptrs to itself...
-				*/
-				head->next = head;
-				head->prev = head;
-			}
+			_linkTask(td);
 			break;
 		}
 	}
@@ -416,25 +1435,54 @@ void deregisterTask(uint16_t taskID) {
 
 	if (td != NULL) {
 		td->ID				= 0;
-		td->startTime		= 0;
 		td->scheduledTime	= 0;
 		td->delay			= 0;
 		td->isScheduled		= 0;
 		td->isAllocated		= 0;
+		td->isSuspended		= 0;
+		td->missedCount		= 0;
 		td->pParameter		= NULL;
 		td->run				= &_nullTask;
+
+		_clearSignal(td);
 		
 		taskCount--;
 
 		/*
 		** Unlink the task from the registered queue...
 		*/
-		((PTASKDESC)(td->prev))->next = td->next;
-		((PTASKDESC)(td->next))->prev = td->prev;
+		_unlinkTask(td);
+	}
+}
+
+/******************************************************************************
+**
+** Name: setTaskPriority()
+**
+** Description: Sets the priority of a registered task, from 
+** TASK_PRIORITY_HIGHEST (0) to TASK_PRIORITY_LOWEST (5). Tasks are registered
+** with TASK_PRIORITY_DEFAULT. When more than one task is due to run, the 
+** highest priority task runs first.
+**
+** Parameters:	uint16_t	taskID		The unique ID for the task
+**				uint8_t		priority	The task priority
+**
+** Returns:		void 
+**
+******************************************************************************/
+void setTaskPriority(uint16_t taskID, uint8_t priority) {
+	PTASKDESC	td = NULL;
+
+	td = _findTaskByID(taskID);
 
-		if (head == tail) {
-			head = tail = NULL;
+	if (td != NULL) {
+		if (priority > TASK_PRIORITY_LOWEST) {
+			priority = TASK_PRIORITY_LOWEST;
 		}
+
+		_unlinkTask(td);
+		td->priority = priority;
+		_linkTask(td);
 	}
 }
 
@@ -459,12 +1507,15 @@ void scheduleTask(uint16_t taskID, rtc_t time, bool isPeriodic, PTASKPARM p) {
 	td = _findTaskByID(taskID);
 
 	if (td != NULL) {
-		td->startTime = getRTCClockCount();
-		td->delay = time;
-		td->scheduledTime = _getScheduledTime(td->startTime, td->delay);
-		td->isScheduled = 1;
-		td->isPeriodic = (uint8_t)isPeriodic;
 		td->pParameter = p;
+
+#ifdef PICO_MULTICORE
+		if (!_isLocalTask(td, getCoreID())) {
+			_postMessage(SCHED_MSG_SCHEDULE, td, time, isPeriodic);
+			return;
+		}
+#endif
+		_scheduleLocalTask(td, time, isPeriodic);
 	}
 }
 
@@ -479,6 +1530,9 @@ void scheduleTask(uint16_t taskID, rtc_t time, bool isPeriodic, PTASKPARM p) {
 ** If you want to reschedule the task to run after a different delay, simply
 ** call scheduleTask() instead.
 **
+** Periodic tasks do not need to call this, the scheduler reschedules them 
+** relative to the time they were due to run, so they don't drift.
+**
 ** Parameters:	
 ** uint16_t		taskID		The unique ID for the task
 ** PTASKPARM	p			Pointer to the task parameters, can be NULL
@@ -492,10 +1546,15 @@ void rescheduleTask(uint16_t taskID, PTASKPARM p) {
 	td = _findTaskByID(taskID);
 
 	if (td != NULL) {
-		td->startTime = getRTCClockCount();
-		td->scheduledTime = _getScheduledTime(td->startTime, td->delay);
-		td->isScheduled = 1;
 		td->pParameter = p;
+
+#ifdef PICO_MULTICORE
+		if (!_isLocalTask(td, getCoreID())) {
+			_postMessage(SCHED_MSG_RESCHEDULE, td, 0, false);
+			return;
+		}
+#endif
+		_rescheduleLocalTask(td);
 	}
 }
 
@@ -518,9 +1577,13 @@ void unscheduleTask(uint16_t taskID) {
 	td = _findTaskByID(taskID);
 
 	if (td != NULL) {
-		td->startTime = 0;
-		td->scheduledTime = 0;
-		td->isScheduled = 0;
+#ifdef PICO_MULTICORE
+		if (!_isLocalTask(td, getCoreID())) {
+			_postMessage(SCHED_MSG_UNSCHEDULE, td, 0, false);
+			return;
+		}
+#endif
+		_unscheduleLocalTask(td);
 		td->pParameter = NULL;
 	}
 }
@@ -549,23 +1612,192 @@ void scheduleTaskExlusive(uint16_t taskID, rtc_t time, bool isPeriodic, PTASKPAR
 		td = &taskDescs[i];
 
 		if (td->ID == taskID) {
-			td->startTime = getRTCClockCount();
-			td->delay = time;
-			td->scheduledTime = _getScheduledTime(td->startTime, td->delay);
-			td->isScheduled = 1;
-			td->isPeriodic = (uint8_t)isPeriodic;
-			td->pParameter = p;
+			scheduleTask(taskID, time, isPeriodic, p);
 		}
 		else {
-			td->startTime = 0;
-			td->scheduledTime = 0;
-			td->isScheduled = 0;
+#ifdef PICO_MULTICORE
+			if (td->isAllocated && !_isLocalTask(td, getCoreID())) {
+				_postMessage(SCHED_MSG_UNSCHEDULE, td, 0, false);
+				continue;
+			}
+#endif
+			_unscheduleLocalTask(td);
 			td->isPeriodic = false;
 			td->pParameter = NULL;
 		}
 	}
 }
 
+/******************************************************************************
+**
+** Name: suspendAllTasksExcept()
+**
+** Description: Suspends all tasks except the one specified, e.g. before 
+** putting the chip into a long sleep. Unlike scheduleTaskExclusive(), the
+** suspended tasks keep their schedules and any signals, they just won't 
+** run until resumeAllTasks() is called.
+**
+** Parameters:	
+** uint16_t		taskID		The unique ID for the task to keep running
+**
+** Returns:		void 
+**
+******************************************************************************/
+void suspendAllTasksExcept(uint16_t taskID) {
+	PTASKDESC	td = NULL;
+	int			i;
+
+	for (i = 0;i < taskArrayLength;i++) {
+		td = &taskDescs[i];
+
+		if (td->isAllocated && td->ID != taskID) {
+#ifdef PICO_MULTICORE
+			if (!_isLocalTask(td, getCoreID())) {
+				_postMessage(SCHED_MSG_SUSPEND, td, 0, false);
+				continue;
+			}
+#endif
+			td->isSuspended = 1;
+		}
+	}
+}
+
+/******************************************************************************
+**
+** Name: resumeAllTasks()
+**
+** Description: Resumes all suspended tasks. Any task that became due while
+** suspended runs straight away, periodic tasks skip the periods they missed.
+**
+** Parameters:	N/A
+**
+** Returns:		void 
+**
+******************************************************************************/
+void resumeAllTasks() {
+	PTASKDESC	td = NULL;
+	int			i;
+
+	for (i = 0;i < taskArrayLength;i++) {
+		td = &taskDescs[i];
+
+		if (td->isAllocated) {
+#ifdef PICO_MULTICORE
+			/*
+			** Only the owning core can see if its task is suspended, the
+			** suspend message may still be in the FIFO ahead of us...
+			*/
+			if (!_isLocalTask(td, getCoreID())) {
+				_postMessage(SCHED_MSG_RESUME, td, 0, false);
+				continue;
+			}
+#endif
+			td->isSuspended = 0;
+		}
+	}
+}
+
+/******************************************************************************
+**
+** Name: lockoutOtherCore()
+**
+** Description: Called on core 0 before erasing or programming the flash,
+** waits for core 1 to finish the task it is running & park itself in RAM.
+** Does nothing if core 1 is not running. Must be paired with 
+** releaseOtherCore().
+**
+** Parameters:	N/A
+**
+** Returns:		void 
+**
+******************************************************************************/
+void lockoutOtherCore() {
+#ifdef PICO_MULTICORE
+	if (!_isCore1Running || getCoreID() != 0) {
+		return;
+	}
+
+	_isLockoutRequested = true;
+	__dmb();
+
+	/*
+	** Wake core 1 if it is idle...
+	*/
+	__sev();
+
+	while (!_isCore1Parked) {
+		tight_loop_contents();
+	}
+#endif
+}
+
+/******************************************************************************
+**
+** Name: releaseOtherCore()
+**
+** Description: Lets core 1 carry on after lockoutOtherCore(), returns 
+** once it has left the lockout.
+**
+** Parameters:	N/A
+**
+** Returns:		void 
+**
+******************************************************************************/
+void releaseOtherCore() {
+#ifdef PICO_MULTICORE
+	if (!_isCore1Running || getCoreID() != 0) {
+		return;
+	}
+
+	__dmb();
+	_isLockoutRequested = false;
+
+	/*
+	** Wait for core 1 to leave _parkCore1(), otherwise a lockout straight
+	** after this would see it still parked & not wait for it to park 
+	** again, while it goes back to running from flash...
+	*/
+	while (_isCore1Parked) {
+		tight_loop_contents();
+	}
+#endif
+}
+
+/******************************************************************************
+**
+** Name: signalTask()
+**
+** Description: Marks a registered task as ready to run, without changing
+** its schedule. Safe to call from interrupt handlers on either core, so 
+** GPIO, PIO, DMA and other interrupts can trigger a task rather than the
+** task polling for the event. Signals are not counted, if a task is 
+** signalled more than once before it runs, it runs once.
+**
+** Signals from core 1 to a task on core 0 are picked up on the next tick.
+**
+** Parameters:	
+** uint16_t		taskID		The unique ID for the task
+**
+** Returns:		void 
+**
+******************************************************************************/
+void signalTask(uint16_t taskID) {
+	PTASKDESC	td = NULL;
+	uint32_t	status;
+
+	td = _findTaskByID(taskID);
+
+	if (td != NULL) {
+		status = _lockSignals();
+		_signalPending |= _signalBit(td);
+		_unlockSignals(status);
+
+#ifdef PICO_MULTICORE
+		__sev();
+#endif
+	}
+}
+
 /******************************************************************************
 **
 ** Name: schedule()
@@ -580,53 +1812,47 @@ void scheduleTaskExlusive(uint16_t taskID, rtc_t time, bool isPeriodic, PTASKPAR
 ******************************************************************************/
 void schedule()
 {
-	PTASKDESC	td = head;
+#ifdef PICO_MULTICORE
+	uint8_t		core = getCoreID();
+#else
+	uint8_t		core = 0;
+#endif
 	
 	/*
 	** If no tasks have been registered, just loop until some are...
 	*/
-	while (td == NULL) {
+	while (head == NULL) {
 		__wfi();
 	}
 
+#ifdef PICO_MULTICORE
+	/*
+	** Core 1 runs its own copy of this loop over the tasks that
+	** have been given core 1 affinity with setTaskAttributes()...
+	*/
+	if (core == 0 && _isCore1Required()) {
+		multicore_launch_core1(&_core1Entry);
+	}
+#endif
+
 	/*
 	** Scheduler loop, run forever waiting for tasks to be
-	** scheduled...
+	** scheduled. Each pass runs the highest priority task that
+	** is due, so if more than one task is due the next to run
+	** is always the highest priority one. When nothing is due,
+	** sleep until the next interrupt to save power...
 	*/
 	while (1) {
-		if (td->isScheduled && getRTCClockCount() >= td->scheduledTime) {
-			/*
-			** Mark the task as un-scheduled, so by default the
-			** task will not run again automatically. If the task
-			** is periodic or if the task reschedules itself, this 
-			** flag will be reset to 1...
-			*/
-			td->isScheduled = 0;
-
-			/*
-			** Run the task...
-			*/
-            td->run(td->pParameter);
-
-			if (td->isPeriodic && !td->isScheduled) {
-				rescheduleTask(td->ID, td->pParameter);
-			}
+#ifdef PICO_MULTICORE
+		_processMessages();
 
-			_tasksRunCount++;
+		if (core == 1 && _isLockoutRequested) {
+			_parkCore1();
 		}
-
-		td = td->next;
-
-#ifdef UNIT_TEST_MODE
-		usleep(500L);
 #endif
-		if (td == head) {
-			/*
-			** If we've looped through all the registered tasks, sleep
-			** until the next interrupt to save power...
-			*/
-			// deepSleep();
-			__wfi();
+
+		if (!_runNextDueTask(core)) {
+			_idle(core);
 		}
 	}
 }
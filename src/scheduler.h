@@ -3,6 +3,7 @@
 
 #ifdef PICO_MULTICORE
 #include "pico/stdlib.h"
+#include "hardware/structs/sio.h"
 #endif
 
 #ifndef _INCL_SCHEDULER
@@ -17,7 +18,30 @@
 // #define MAX_INT_SIZE			64
 // #endif
 
-#define DEFAULT_MAX_TASKS       64
+/*
+** The size of the static task table, each task costs sizeof(TASKDESC)
+** bytes of RAM. Can be overridden at compile time, up to 64 tasks...
+*/
+#ifndef SCHED_MAX_TASKS
+#define SCHED_MAX_TASKS         16
+#endif
+
+/*
+** A periodic task that is late by up to this many periods runs the late
+** periods back-to-back to catch up, any more are skipped...
+*/
+#ifndef SCHED_MAX_CATCH_UP_PERIODS
+#define SCHED_MAX_CATCH_UP_PERIODS  8
+#endif
+
+/*
+** Task priorities, when more than one task is due to run the task
+** with the highest priority (lowest number) runs first...
+*/
+#define TASK_PRIORITY_HIGHEST   0
+#define TASK_PRIORITY_LOWEST    5
+#define TASK_PRIORITY_DEFAULT   3
+#define TASK_NUM_PRIORITIES     (TASK_PRIORITY_LOWEST + 1)
 
 typedef void *					PTASKPARM;
 
@@ -41,28 +65,31 @@ typedef uint32_t				rtc_t;
 ******************************************************************************/
 typedef struct
 {
-	uint16_t		ID;				// Unique user-assigned ID
-	rtc_t			startTime;		// The RTC value when scheduleTask() was callled
-	rtc_t			scheduledTime;	// The RTC value when the task should run
-	rtc_t			delay;			// The requested delay (in ms) of when the task should run
-	uint8_t			priority;		// Task priority 0 (highest) to 5 (lowest)
-	uint8_t			type;			// Task type - Periodic, On-demand
-	uint8_t			isScheduled;	// Is this task scheduled
-	uint8_t			isAllocated;	// Is this allocated to a task
-	uint8_t			isPeriodic;		// Should this task run repeatdly at the specified delay
-	PTASKPARM		pParameter;		// The parameters to the task
-	
-	void (* run)(PTASKPARM);		// Pointer to the task function to run
-									// Must be of the form void task(PTASKPARM p);
-	void * 			next;
-	void *			prev;
+	rtc_t			scheduledTime;		// The RTC value when the task should run
+	uint32_t		delay;				// The requested delay (in RTC ticks) of when the task should run
+	PTASKPARM		pParameter;			// The parameters to the task
+
+	void (* run)(PTASKPARM);			// Pointer to the task function to run
+										// Must be of the form void task(PTASKPARM p);
+	uint16_t		ID;					// Unique user-assigned ID
+	uint16_t		missedCount;		// Number of periods missed by a periodic task
+	uint8_t			next;				// Index of the next task in the registered queue
+	uint8_t			prev;				// Index of the previous task in the registered queue
+	uint8_t			isScheduled : 1;	// Is this task scheduled
+	uint8_t			isAllocated : 1;	// Is this allocated to a task
+	uint8_t			isPeriodic : 1;		// Should this task run repeatdly at the specified delay
+	uint8_t			coreID : 1;			// The core this task runs on
+	uint8_t			priority : 3;		// Task priority 0 (highest) to 5 (lowest)
+	uint8_t			isSuspended : 1;	// Is this task suspended, it keeps its schedule but won't run
 }
 TASKDESC;
 
 typedef TASKDESC *	PTASKDESC;
 
 PTASKDESC 	getRegisteredTasks();
+PTASKDESC	getNextTask(PTASKDESC td);
 int 		isLastTask(PTASKDESC td);
+int			scheduleDueTasks();
 #endif
 
 typedef struct
@@ -74,6 +101,33 @@ CPU_RATIO;
 
 typedef CPU_RATIO *	PCPU_RATIO;
 
+typedef struct
+{
+	uint32_t		runCount;			// Number of timed runs measured
+	uint32_t		totalLatency;		// Total dispatch latency (us)
+	uint32_t		maxLatency;			// Worst case dispatch latency (us)
+}
+TASK_LATENCY;
+
+typedef TASK_LATENCY *	PTASK_LATENCY;
+
+/*
+** Dispatch latency histogram buckets, bucket n counts latencies of
+** 2^(n-1) to (2^n)-1 us, the last bucket counts anything longer...
+*/
+#define SCHED_LATENCY_BUCKETS	24
+
+typedef struct
+{
+	uint32_t		latencyHistogram[SCHED_LATENCY_BUCKETS];
+	uint32_t		idleCount;			// Number of times the scheduler has idled
+	uint32_t		taskCount;			// Number of registered tasks
+	uint32_t		memoryUsed;			// Bytes used by the static task table
+}
+SCHED_STATS;
+
+typedef SCHED_STATS *	PSCHED_STATS;
+
 #ifdef PICO_MULTICORE
 #define getCoreID()						(uint8_t)(sio_hw->cpuid & 0xFF)
 #endif
@@ -82,20 +136,33 @@ typedef CPU_RATIO *	PCPU_RATIO;
 */
 #define RUN_NOW                 0
 
+/*
+** Passed as the runTime to the trace task just before a task runs.
+*/
+#define TRACE_TASK_START        0xFFFFFFFF
+
 /******************************************************************************
 **
 ** The real-time clock interrupt service routing
 **
 ******************************************************************************/
 void        _rtcISR();
+void        _rtcISRTicks(uint32_t ticks);
 
 /******************************************************************************
 **
-** Get the last recorded busy/idle CPU counts
+** Get the busy/idle CPU time (us) on core 0 since the last call
 **
 ******************************************************************************/
 void getCPURatio(PCPU_RATIO cpuRatio);
 
+/******************************************************************************
+**
+** Get the dispatch latency histogram, idle count and memory usage
+**
+******************************************************************************/
+void getSchedulerStats(PSCHED_STATS stats);
+
 /******************************************************************************
 **
 ** Get the total number of tasks run by the scheduler
@@ -103,6 +170,25 @@ void getCPURatio(PCPU_RATIO cpuRatio);
 ******************************************************************************/
 uint32_t getTaskRunCount();
 
+/******************************************************************************
+**
+** Get the dispatch latency stats for the tasks at the given priority. The
+** latency is the time from the tick on which a task became due to when it
+** started running, tasks scheduled with RUN_NOW are not measured.
+**
+******************************************************************************/
+void getTaskLatency(uint8_t priority, PTASK_LATENCY latency);
+
+/******************************************************************************
+**
+** Get the number of periods skipped by a periodic task because it, or the
+** tasks ahead of it, overran by more than SCHED_MAX_CATCH_UP_PERIODS.
+** getMissedPeriodCount() is the total for all tasks.
+**
+******************************************************************************/
+uint16_t getTaskMissedPeriods(uint16_t taskID);
+uint32_t getMissedPeriodCount();
+
 /******************************************************************************
 **
 ** Get the scheduler version string and build date
@@ -121,14 +207,22 @@ rtc_t       getRTCClock(void);
 void 		initScheduler(int size);
 
 void        registerTickTask(void (* tickTask)());
+void        registerIdleTask(void (* idleTask)(rtc_t ticksToNext));
+void        registerTraceTask(void (* traceTask)(uint16_t taskID, uint8_t core, uint32_t runTime));
 
 void		registerTask(uint16_t taskID, void (* run)(PTASKPARM));
 void		deregisterTask(uint16_t taskID);
+void		setTaskPriority(uint16_t taskID, uint8_t priority);
 
 void        scheduleTask(uint16_t taskID, rtc_t time, bool isPeriodic, PTASKPARM p);
 void		rescheduleTask(uint16_t taskID, PTASKPARM p);
 void		unscheduleTask(uint16_t taskID);
 void 		scheduleTaskExlusive(uint16_t taskID, rtc_t time, bool isPeriodic, PTASKPARM p);
+void		signalTask(uint16_t taskID);
+void		suspendAllTasksExcept(uint16_t taskID);
+void		resumeAllTasks();
+void		lockoutOtherCore();
+void		releaseOtherCore();
 
 void		schedule();
 
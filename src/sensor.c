@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <math.h>
 
 #include "hardware/i2c.h"
@@ -20,8 +21,15 @@
 #include "icp10125.h"
 #include "max17048.h"
 #include "nRF24L01.h"
+#include "rain.h"
+#include "radio.h"
 #include "gpio_cntrl.h"
 #include "utils.h"
+#include "clock_rp2040.h"
+#include "budget.h"
+#include "flashlog.h"
+#include "persist.h"
+#include "crash.h"
 
 #define STATE_I2C_INIT              0x0001
 #define STATE_I2C_INIT2             0x0002
@@ -29,61 +37,129 @@
 #define STATE_SETUP_I2C0            0x0010
 #define STATE_SETUP_I2C1            0x0020
 #define STATE_SETUP_LC709203        0x0030
-#define STATE_READ_TEMP             0x0100
-#define STATE_READ_HUMIDITY_1       0x0200
+#define STATE_READ_SENSORS          0x0100
 #define STATE_READ_HUMIDITY_2       0x0201
-#define STATE_READ_PRESSURE_1       0x0300
-#define STATE_READ_PRESSURE_2       0x0301
-#define STATE_READ_PRESSURE_3       0x0302
 #define STATE_LTR390_ENABLE         0x0400
 #define STATE_READ_ALS              0x0410
 #define STATE_READ_UVS              0x0420
-#define STATE_READ_BATTERY_VOLTS    0x0500
-#define STATE_READ_BATTERY_PERCENT  0x0501
-#define STATE_READ_BATTERY_TEMP     0x0502
-#define STATE_READ_BATTERY_CRATE    0x0503
 #define STATE_SEND_BEGIN            0x0700
 #define STATE_SEND_FINISH           0x0701
 #define STATE_CRC_FAILURE_1         0x0900
 #define STATE_CRC_FAILURE_2         0x0901
 #define STATE_CRC_FAILURE_3         0x0902
-#define STATE_SEND_PACKET           0x07FF
 
 #define CRC_FAIL_COUNT_LIMIT        3
 
 static const uint MESSAGE_DELAY_DEBUG_MS =      (1 * 60 * 1000);    // 1 minute
-static const uint MESSAGE_DELAY_STD_MS =        (4 * 60 * 1000);    // 4 minutes
-static const uint MESSAGE_DELAY_MED_PWR_MS =    (20 * 60 * 1000);   // 20 minutes
-static const uint MESSAGE_DELAY_LOW_PWR_MS =    (60 * 60 * 1000);   // 1 hour
 
 static uint8_t              buffer[32];
 static char                 szBuffer[128];
+static bool                 doResetCycle = false;
+
+/*
+** We hold CLOCK_PERF_STD from the start of the send until the radio has
+** finished, the radio runs its SPI transfers on core 1 so the clock must
+** not change underneath it...
+*/
+static bool                 isClockHeld = false;
+
+/*
+** The pressure sensor transfers run in the background, so their buffers
+** must outlive the task call...
+*/
+static uint8_t              icpMeasureCmd[2] = {0x70, 0xDF};
+static uint8_t              icpResult[9];
+static const i2c_segment_t  icpMeasureSegment = {icpMeasureCmd, sizeof(icpMeasureCmd)};
+static const i2c_segment_t  icpResultSegment = {icpResult, sizeof(icpResult)};
 
 int nullSetup(i2c_inst_t * i2c) {
     return 0;
 }
 
+/*
+** The packet number carries on across a reset, so the base station 
+** can tell a reset from lost packets...
+*/
 static void setPacketNumber(weather_packet_t * p) {
-    static uint32_t             packetNum = 0;
+    uint32_t                    packetNum;
 
-    packetNum &= 0x00FFFFFF;
+    packetNum = persistGetPacketNumber() & 0x00FFFFFF;
 
     p->packetNum[0] = (uint8_t)(packetNum & 0x000000FF);
     p->packetNum[1] = (uint8_t)((packetNum >> 8) & 0x000000FF);
     p->packetNum[2] = (uint8_t)((packetNum >> 16) & 0x000000FF);
 
-    packetNum++;
+    persistSetPacketNumber(packetNum + 1);
 }
 
-static int registerSensorsI2C0(void) {
+/*
+** Start the next sensor cycle from the beginning, e.g. after waking 
+** from a long sleep when the I2C & SPI buses have been shut down...
+*/
+void sensorResetCycle(void) {
+    doResetCycle = true;
+}
+
+/*
+** Lower precision humidity readings convert faster, so keep the
+** rail on for less time when the energy budget is tight...
+*/
+static sht4x_precision_t _getHumidityPrecision(budget_level_t level) {
+    switch (level) {
+        case BUDGET_LEVEL_MINIMAL:
+            return SHT4X_PRECISION_LOW;
+
+        case BUDGET_LEVEL_REDUCED:
+            return SHT4X_PRECISION_MEDIUM;
+
+        default:
+            return SHT4X_PRECISION_HIGH;
+    }
+}
+
+/*
+** Merge the health of both buses into the one byte, the devices on I2C1
+** follow those on I2C0...
+*/
+static uint8_t _getI2CHealth(void) {
+#ifdef I2C_DUAL_BUS
+    uint8_t         th = i2cGetBusHealth(SENSOR_I2C_TH);
+    uint8_t         pb = i2cGetBusHealth(SENSOR_I2C_PB);
+    uint8_t         devices;
+    uint8_t         recoveries;
+
+    devices = (th | (pb << SENSOR_I2C_TH_DEVICES)) & I2C_HEALTH_DEVICE_MASK;
+    recoveries = (th >> I2C_HEALTH_RECOVERY_SHIFT) + (pb >> I2C_HEALTH_RECOVERY_SHIFT);
+
+    if (recoveries > I2C_HEALTH_RECOVERY_MAX) {
+        recoveries = I2C_HEALTH_RECOVERY_MAX;
+    }
+
+    return (devices | (recoveries << I2C_HEALTH_RECOVERY_SHIFT));
+#else
+    return i2cGetBusHealth(SENSOR_I2C_TH);
+#endif
+}
+
+static int registerSensors(void) {
     int         rtn = 0;
 
-    i2c_bus_open(i2c0, 4);
+#ifdef I2C_DUAL_BUS
+    i2c_bus_open(SENSOR_I2C_TH, SENSOR_I2C_TH_DEVICES);
+    i2c_bus_open(SENSOR_I2C_PB, 2);
+#else
+    i2c_bus_open(SENSOR_I2C_TH, 4);
+#endif
+
+    i2c_bus_register_device(SENSOR_I2C_TH, TMP117_ADDRESS, TMP117_MAX_BAUDRATE, &tmp117_setup, &tmp117_probe);
+    i2c_bus_register_device(SENSOR_I2C_TH, SHT4X_ADDRESS, SHT4X_MAX_BAUDRATE, &sht4x_setup, &sht4x_probe);
+    i2c_bus_register_device(SENSOR_I2C_PB, ICP10125_ADDRESS, ICP10125_MAX_BAUDRATE, &icp10125_setup, &icp10125_probe);
+    i2c_bus_register_device(SENSOR_I2C_PB, MAX17048_ADDRESS, MAX17048_MAX_BAUDRATE, &max17048_setup, &max17048_probe);
 
-    i2c_bus_register_device(i2c0, TMP117_ADDRESS, &tmp117_setup);
-    i2c_bus_register_device(i2c0, SHT4X_ADDRESS, &sht4x_setup);
-    i2c_bus_register_device(i2c0, ICP10125_ADDRESS, &icp10125_setup);
-    i2c_bus_register_device(i2c0, MAX17048_ADDRESS, &max17048_setup);
+    sht4x_set_heater_schedule(
+                SHT4X_HEATER_INTERVAL_CYCLES, 
+                SHT4X_HEATER_RH_THRESHOLD, 
+                SHT4X_HEATER_CMD);
 
     return rtn;
 }
@@ -92,22 +168,50 @@ void taskI2CSensor(PTASKPARM p) {
     static int                  state = STATE_START;
     static rtc_t                msDelayTotal = 0;
     static weather_packet_t     lastPacket;
+    static int                  retryCount = 0;
+    static int                  minimalCount = 0;
     int                         i;
     int                         count = 0;
     int                         bytesRead = 0;
+    int                         error;
     int                         p_LSB;
     int                         t_LSB;
     int                         icpPressure;
-    uint8_t                     input[2];
+    int16_t                     rawTemperature;
+    uint16_t                    rawSHTTemperature;
+    uint16_t                    rawHumidity;
+    int                         heaterTime;
+    bool                        isHeaterDue;
+    bool                        isLiveSend;
+    int                         backlogCount;
+    bool                        isRadioNeeded = false;
+    watchdog_packet_t *         pWatchdog;
+    max17048_gauge_t            gauge;
     rtc_t                       delay;
 
     weather_packet_t * pWeather = getWeatherPacket();
 
+    if (doResetCycle) {
+        if (state != STATE_START) {
+            state = STATE_I2C_INIT;
+        }
+
+        pWeather->status = 0x0000;
+        msDelayTotal = 0;
+
+        if (isClockHeld) {
+            clockRelease(CLOCK_PERF_STD);
+            isClockHeld = false;
+        }
+
+        doResetCycle = false;
+    }
+
     switch (state) {
         case STATE_START:
             lgLogDebug("I2C Start");
 
-            registerSensorsI2C0();
+            registerSensors();
 
             memset(pWeather, 0, sizeof(weather_packet_t));
 
@@ -120,8 +224,11 @@ void taskI2CSensor(PTASKPARM p) {
 
             lgLogDebug("I2C Init2");
 
-            i2c_init(i2c0, 400000);
-            spi_init(spi0, 5000000);
+            clockI2CInit(i2c0, I2C_BAUDRATE_FAST);
+#ifdef I2C_DUAL_BUS
+            clockI2CInit(i2c1, I2C_BAUDRATE_FAST);
+#endif
+            clockSPIInit(spi0, 5000000);
             nRF24L01_setup(spi0);
 
             state = STATE_SETUP_I2C0;
@@ -132,21 +239,56 @@ void taskI2CSensor(PTASKPARM p) {
         case STATE_SETUP_I2C0:
             lgLogDebug("I2C0 Setup");
 
-            i2c_bus_setup(i2c0);
+            /*
+            ** The devices must be powered before they can be set up,
+            ** e.g. so the ICP10125 OTP calibration can be read...
+            */
             i2cBusPowerUp();
+            sleep_ms(2U);
+            i2c_bus_setup(SENSOR_I2C_TH);
+#ifdef I2C_DUAL_BUS
+            i2c_bus_setup(SENSOR_I2C_PB);
+#endif
 
-            state = STATE_READ_TEMP;
-            delay = rtc_val_ms(500);
+            /*
+            ** Start all the conversions together, the pressure sensor's
+            ** command goes out on its bus while we talk to the others...
+            */
+            i2cTransactionStart(SENSOR_I2C_PB, ICP10125_ADDRESS, &icpMeasureSegment, 1, NULL, 0);
+
+            tmp117_start_one_shot(SENSOR_I2C_TH);
+            sht4x_start_measure(SENSOR_I2C_TH, _getHumidityPrecision(budgetGetSensorLevel()));
+
+            i2cTransactionWait(SENSOR_I2C_PB);
+
+            retryCount = 0;
+
+            /*
+            ** The TMP117 is the slowest to convert...
+            */
+            state = STATE_READ_SENSORS;
+            delay = rtc_val_ms_min(TMP117_ONE_SHOT_TIME_MS);
             msDelayTotal += delay;
             break;
 
-        case STATE_READ_TEMP:
-            lgLogDebug("Rd T");
+        case STATE_READ_SENSORS:
+            lgLogDebug("Rd S");
+
+            error = tmp117_read_temperature(SENSOR_I2C_TH, &rawTemperature);
+
+            if (error == PICO_ERROR_NO_DATA && retryCount < TMP117_READY_RETRIES) {
+                /*
+                ** The tick may have come round a little early...
+                */
+                retryCount++;
 
-            bytesRead = i2cReadRegister(i2c0, TMP117_ADDRESS, TMP117_REG_TEMP, buffer, 2);
+                delay = rtc_val_ms(100);
+                msDelayTotal += delay;
+                break;
+            }
 
-            if (bytesRead > 0) {
-                pWeather->rawTemperature = copyI2CReg_int16(buffer);
+            if (error == 0) {
+                pWeather->rawTemperature = rawTemperature;
                 lastPacket.rawTemperature = pWeather->rawTemperature;
             }
             else {
@@ -154,30 +296,15 @@ void taskI2CSensor(PTASKPARM p) {
                 pWeather->status |= STATUS_BITS_TMP117_I2C_ERROR;
             }
 
-            state = STATE_READ_HUMIDITY_1;
-            delay = rtc_val_ms(500);
-            msDelayTotal += delay;
-            break;
-
-        case STATE_READ_HUMIDITY_1:
-            lgLogDebug("Rd H1");
-
-            input[0] = SHT4X_CMD_MEASURE_HI_PRN;
-
-            i2cWriteTimeoutProtected(i2c0, SHT4X_ADDRESS, input, 1, true);
-
-            state = STATE_READ_HUMIDITY_2;
-            delay = rtc_val_ms(100);
-            msDelayTotal += delay;
-            break;
-
-        case STATE_READ_HUMIDITY_2:
-            lgLogDebug("Rd H2");
+            /*
+            ** Read the pressure on its bus while we read the humidity...
+            */
+            i2cTransactionStart(SENSOR_I2C_PB, ICP10125_ADDRESS, NULL, 0, &icpResultSegment, 1);
 
-            bytesRead = i2cReadTimeoutProtected(i2c0, SHT4X_ADDRESS, buffer, 6, false);
+            error = sht4x_read(SENSOR_I2C_TH, &rawSHTTemperature, &rawHumidity);
 
-            if (bytesRead > 0) {
-                pWeather->rawHumidity = copyI2CReg_uint16(&buffer[3]);
+            if (error == 0) {
+                pWeather->rawHumidity = rawHumidity;
                 lastPacket.rawHumidity = pWeather->rawHumidity;
             }
             else {
@@ -185,140 +312,142 @@ void taskI2CSensor(PTASKPARM p) {
                 pWeather->status |= STATUS_BITS_SHT4X_I2C_ERROR;
             }
 
-            state = STATE_READ_PRESSURE_1;
-            delay = rtc_val_ms(400);
-            msDelayTotal += delay;
-            break;
-
-        case STATE_READ_PRESSURE_1:
-            lgLogDebug("Rd P1");
-
-            icp10125_read_otp(i2c0);
-
-            state = STATE_READ_PRESSURE_2;
-            delay = rtc_val_ms(100);
-            msDelayTotal += delay;
-            break;
-
-        case STATE_READ_PRESSURE_2:
-            lgLogDebug("Rd P2");
-            
-            input[0] = 0x70;
-            input[1] = 0xDF;
-
-            i2cWriteTimeoutProtected(i2c0, ICP10125_ADDRESS, input, 2, false);
-
-            state = STATE_READ_PRESSURE_3;
-            delay = rtc_val_ms(100);
-            msDelayTotal += delay;
-            break;
+            /*
+            ** Count every cycle towards the heater schedule, a pulse due
+            ** when we can't afford it is skipped rather than saved up
+            ** for when the budget recovers...
+            */
+            isHeaterDue = sht4x_is_heater_due(pWeather->rawHumidity);
 
-        case STATE_READ_PRESSURE_3:
-            lgLogDebug("Rd P3");
-            
-            bytesRead = i2cReadTimeoutProtected(i2c0, ICP10125_ADDRESS, buffer, 9, false);
+            if (error != 0 || budgetGetSensorLevel() != BUDGET_LEVEL_FULL) {
+                isHeaterDue = false;
+            }
 
-            if (bytesRead == 9) {
-                t_LSB = copyI2CReg_uint16(buffer);
+            bytesRead = i2cTransactionWait(SENSOR_I2C_PB);
 
-                p_LSB = (int)(((int)buffer[3] << 16) | 
-                                ((int)buffer[4] << 8) | 
-                                (int)buffer[6]);
+            if (bytesRead == sizeof(icpResult)) {
+                t_LSB = copyI2CReg_uint16(icpResult);
 
-                icp10125_process_data(p_LSB, t_LSB, &icpPressure);
+                p_LSB = (int)(((int)icpResult[3] << 16) | 
+                                ((int)icpResult[4] << 8) | 
+                                (int)icpResult[6]);
 
-                pWeather->rawICPPressure = (uint32_t)icpPressure;
-                lastPacket.rawICPPressure = pWeather->rawICPPressure;
+                if (icp10125_process_data(p_LSB, t_LSB, &icpPressure) == 0) {
+                    pWeather->rawICPPressure = (uint32_t)icpPressure;
+                    lastPacket.rawICPPressure = pWeather->rawICPPressure;
+                }
+                else {
+                    pWeather->rawICPPressure = lastPacket.rawICPPressure;
+                    pWeather->status |= STATUS_BITS_ICP10125_I2C_ERROR;
+                }
             }
             else {
                 pWeather->rawICPPressure = lastPacket.rawICPPressure;
                 pWeather->status |= STATUS_BITS_ICP10125_I2C_ERROR;
             }
 
-            state = STATE_READ_BATTERY_VOLTS;
-            delay = rtc_val_ms(300);
-            msDelayTotal += delay;
-            break;
-
-        case STATE_READ_BATTERY_VOLTS:
-            lgLogDebug("Rd BV");
+            error = max17048_read_gauge(SENSOR_I2C_PB, &gauge);
 
-            bytesRead = i2cReadRegister(i2c0, MAX17048_ADDRESS, MAX17048_REG_VCELL, buffer, 2);            
+            if (error == 0) {
+                pWeather->rawBatteryVolts = gauge.rawVolts;
+                pWeather->rawBatteryPercentage = gauge.rawPercentage;
+                pWeather->rawBatteryChargeRate = gauge.rawChargeRate;
 
-            lgLogDebug("MAX Bytes read: %d", bytesRead);
-
-            if (bytesRead > 0) {
-                pWeather->rawBatteryVolts = copyI2CReg_uint16(buffer);
                 lastPacket.rawBatteryVolts = pWeather->rawBatteryVolts;
+                lastPacket.rawBatteryPercentage = pWeather->rawBatteryPercentage;
+                lastPacket.rawBatteryChargeRate = pWeather->rawBatteryChargeRate;
+
                 lgLogDebug("BV: %.2f", (float)pWeather->rawBatteryVolts * 78.125f / 1000000.0f);
+                lgLogDebug("BP: %d", (int)pWeather->rawBatteryPercentage);
+                lgLogDebug("BCR: %.2f", (float)pWeather->rawBatteryChargeRate * 0.208f);
+
+                /*
+                ** In case the edge on the alert pin was missed, e.g. it
+                ** fell while the IRQ was being set up, don't rely on it
+                ** alone to get the battery monitor to put us to sleep...
+                */
+                if (max17048_is_alert(&gauge) || gauge.rawPercentage < BATTERY_PERCENTAGE_CRITICAL) {
+                    signalTask(TASK_BATTERY_MONITOR);
+                }
+
+                /*
+                ** Clear any alert the battery monitor has been signalled 
+                ** with & move the threshold to suit the new reading...
+                */
+                max17048_set_alert(SENSOR_I2C_PB, batteryGetAlertThreshold(gauge.rawPercentage));
+
+                budgetUpdate(gauge.rawSOC, gauge.rawChargeRate);
             }
             else {
                 pWeather->rawBatteryVolts = lastPacket.rawBatteryVolts;
-                pWeather->status |= STATUS_BITS_MAX17048_BV_I2C_ERROR;
-            }
-
-            state = STATE_READ_BATTERY_PERCENT;
-            delay = rtc_val_ms(500);
-            msDelayTotal += delay;
-            break;
+                pWeather->rawBatteryPercentage = lastPacket.rawBatteryPercentage;
+                pWeather->rawBatteryChargeRate = lastPacket.rawBatteryChargeRate;
 
-        case STATE_READ_BATTERY_PERCENT:
-            lgLogDebug("Rd BP");
+                pWeather->status |= 
+                            STATUS_BITS_MAX17048_BV_I2C_ERROR | 
+                            STATUS_BITS_MAX17048_BP_I2C_ERROR | 
+                            STATUS_BITS_MAX17048_BCR_I2C_ERROR;
+            }
 
-            bytesRead = i2cReadRegister(i2c0, MAX17048_ADDRESS, MAX17048_REG_SOC, buffer, 2);            
+            /*
+            ** Don't spend battery on the heater unless we can afford it...
+            */
+            if (isHeaterDue) {
+                heaterTime = sht4x_start_heater(SENSOR_I2C_TH);
 
-            lgLogDebug("MAX Bytes read: %d", bytesRead);
+                if (heaterTime > 0) {
+                    lgLogDebug("SHT4x heater on");
 
-            if (bytesRead > 0) {
-                pWeather->rawBatteryPercentage = buffer[0];
-                lastPacket.rawBatteryPercentage = pWeather->rawBatteryPercentage;
-                lgLogDebug("BP: %d", (int)pWeather->rawBatteryPercentage);
-            }
-            else {
-                pWeather->rawBatteryPercentage = lastPacket.rawBatteryPercentage;
-                pWeather->status |= STATUS_BITS_MAX17048_BP_I2C_ERROR;
+                    state = STATE_READ_HUMIDITY_2;
+                    delay = rtc_val_ms_min(heaterTime);
+                    msDelayTotal += delay;
+                    break;
+                }
             }
 
-            state = STATE_READ_BATTERY_CRATE;
-            delay = rtc_val_ms(500);
+            state = STATE_SEND_BEGIN;
+            delay = rtc_val_ms(100);
             msDelayTotal += delay;
             break;
 
-        case STATE_READ_BATTERY_CRATE:
-            lgLogDebug("Rd BCR");
-
-            bytesRead = i2cReadRegister(i2c0, MAX17048_ADDRESS, MAX17048_REG_CRATE, buffer, 2);            
+        case STATE_READ_HUMIDITY_2:
+            lgLogDebug("Rd H2");
 
-            lgLogDebug("MAX Bytes read: %d", bytesRead);
+            /*
+            ** The heater pulse ends with a measurement taken hot, read 
+            ** it to complete the command but don't report it...
+            */
+            error = sht4x_read(SENSOR_I2C_TH, &rawSHTTemperature, &rawHumidity);
 
-            if (bytesRead > 0) {
-                pWeather->rawBatteryChargeRate = copyI2CReg_int16(buffer);
-                lastPacket.rawBatteryChargeRate = pWeather->rawBatteryChargeRate;
-                lgLogDebug("BCR: %.2f", (float)pWeather->rawBatteryChargeRate * 0.208f);
-            }
-            else {
-                pWeather->rawBatteryChargeRate = lastPacket.rawBatteryChargeRate;
-                pWeather->status |= STATUS_BITS_MAX17048_BCR_I2C_ERROR;
+            if (error != 0) {
+                pWeather->status |= STATUS_BITS_SHT4X_I2C_ERROR;
             }
 
             state = STATE_SEND_BEGIN;
-            delay = rtc_val_ms(200);
+            delay = rtc_val_ms(100);
             msDelayTotal += delay;
             break;
 
         case STATE_SEND_BEGIN:
             i2cBusPowerDown();
-            
-            nRF24L01_powerUpTx(spi0);
 
+            clockRequest(CLOCK_PERF_STD);
+            isClockHeld = true;
+            
             setPacketNumber(pWeather);
 
-            state = STATE_SEND_PACKET;
-            delay = rtc_val_ms(400);
-            msDelayTotal += delay;
-            break;
+            /*
+            ** The rain counter is never reset, so if a packet is
+            ** lost the base station can still work out the rainfall
+            ** from the difference between successive packets...
+            */
+            pWeather->rawRainfall = (uint16_t)(rainGetTotalTips() & 0xFFFF);
+            pWeather->rawRainLastHour = rainGetLastHourTips();
+            pWeather->rawRainRateMax = rainGetMaxRate();
+            pWeather->rawI2CHealth = _getI2CHealth();
+
+            persistSave();
 
-        case STATE_SEND_PACKET:
             memcpy(buffer, pWeather, sizeof(weather_packet_t));
 
             if (isDebugActive()) {
@@ -329,44 +458,126 @@ void taskI2CSensor(PTASKPARM p) {
             }
 
             /*
-            ** Reset the rainfall count so we start counting again
-            ** for the next message...
+            ** When the budget is at its tightest, log most readings and
+            ** save the radio for when we can afford it, but still send
+            ** every SENSOR_MINIMAL_LIVE_EVERY'th. Whenever we send, the 
+            ** backlog goes along with the live packet, the radio is 
+            ** powered up anyway...
+            */
+            if (budgetGetSensorLevel() == BUDGET_LEVEL_MINIMAL) {
+                isLiveSend = (++minimalCount >= SENSOR_MINIMAL_LIVE_EVERY);
+            }
+            else {
+                isLiveSend = true;
+            }
+
+            if (isLiveSend) {
+                minimalCount = 0;
+            }
+
+            /*
+            ** Every reading is logged, it stays pending until the base
+            ** station ACKs it, so none are lost while it's down...
+            */
+            if (flashLogAppend(pWeather)) {
+                lgLogError("Failed to log reading");
+            }
+
+            /*
+            ** Always tell the base station why we reset...
             */
-            pWeather->rawRainfall = 0;
+            pWatchdog = getWatchdogPacket();
+
+            if (crashGetReport(pWatchdog)) {
+                radioQueuePacket((uint8_t *)pWatchdog, sizeof(watchdog_packet_t));
+                isRadioNeeded = true;
+            }
 
-            nRF24L01_transmit_buffer(spi0, buffer, sizeof(weather_packet_t), false);
+            if (isLiveSend) {
+                /*
+                ** Hand the packet over to the radio task, which may be
+                ** running on the other core. The backlog only gets what
+                ** room is left in the queue...
+                */
+                flashLogSendLive(buffer, sizeof(weather_packet_t));
+
+                backlogCount = radioGetQueueSpace();
+
+                if (backlogCount > FLASHLOG_UPLOAD_BATCH) {
+                    backlogCount = FLASHLOG_UPLOAD_BATCH;
+                }
+
+                flashLogUpload(backlogCount);
+                isRadioNeeded = true;
+            }
+
+            if (isRadioNeeded) {
+                radioStart();
+            }
+            else {
+                clockRelease(CLOCK_PERF_STD);
+                isClockHeld = false;
+            }
 
             state = STATE_SEND_FINISH;
-            delay = rtc_val_ms(400);
+            delay = rtc_val_ms(800);
             msDelayTotal += delay;
             break;
 
         case STATE_SEND_FINISH:
-            nRF24L01_powerDown(spi0);
+            /*
+            ** Wait for the radio to finish before we turn off the SPI...
+            */
+            if (radioIsBusy()) {
+                delay = rtc_val_ms(100);
+                msDelayTotal += delay;
+                break;
+            }
+
+            if (isClockHeld) {
+                clockRelease(CLOCK_PERF_STD);
+                isClockHeld = false;
+            }
+
+            /*
+            ** Mark whatever the base station ACKed as uploaded...
+            */
+            flashLogConfirm();
 
             pWeather->status = 0x0000;
 
-            i2c_deinit(i2c0);
-            spi_deinit(spi0);
+            clockI2CDeinit(i2c0);
+#ifdef I2C_DUAL_BUS
+            clockI2CDeinit(i2c1);
+#endif
+            clockSPIDeinit(spi0);
             deInitGPIOs();
 
+            /*
+            ** The budget picks the report interval, msDelayTotal is the
+            ** time (in ticks) we've already spent on this cycle...
+            */
             if (isDebugActive()) {
-                delay = rtc_val_ms(MESSAGE_DELAY_DEBUG_MS - msDelayTotal);
+                delay = rtc_val_ms(MESSAGE_DELAY_DEBUG_MS);
             }
             else {
-                if (pWeather->rawBatteryPercentage < BATTERY_PERCENTAGE_MEDIUM) {
-                    delay = rtc_val_ms(MESSAGE_DELAY_LOW_PWR_MS - msDelayTotal);
-                }
-                else if (pWeather->rawBatteryPercentage < BATTERY_PERCENTAGE_OK) {
-                    delay = rtc_val_ms(MESSAGE_DELAY_MED_PWR_MS - msDelayTotal);
-                }
-                else {
-                    delay = rtc_val_ms(MESSAGE_DELAY_STD_MS - msDelayTotal);
-                }
+                delay = rtc_val_ms(budgetGetReportInterval());
+            }
+
+            if (delay > msDelayTotal) {
+                delay -= msDelayTotal;
+            }
+            else {
+                delay = rtc_val_ms(100);
             }
 
             msDelayTotal = 0;
 
+            /*
+            ** We must get back here by the end of the next cycle...
+            */
+            watchdogRegisterTask(TASK_I2C_SENSOR, delay + rtc_val_sec(SENSOR_CYCLE_MAX_SEC));
+
             state = STATE_I2C_INIT;
             break;
     }
@@ -7,8 +7,39 @@
 #ifndef __INCL_I2C_SENSOR
 #define __INCL_I2C_SENSOR
 
+/*
+** The longest a sensor cycle should take, from waking to sending...
+*/
+#define SENSOR_CYCLE_MAX_SEC                30
+
+/*
+** At BUDGET_LEVEL_MINIMAL readings are only logged, but every Nth one
+** is still sent live (with the backlog) so the base station knows we
+** are alive. The interval is 45 - 120 minutes at that level...
+*/
+#define SENSOR_MINIMAL_LIVE_EVERY           3
+
+/*
+** The bus each sensor is on. With I2C_DUAL_BUS the pressure sensor & 
+** battery gauge move to I2C1, so they can be read at the same time as
+** the temperature & humidity sensors on I2C0...
+**
+** SENSOR_I2C_TH    TMP117 & SHT4x
+** SENSOR_I2C_PB    ICP10125 & MAX17048
+*/
+#define SENSOR_I2C_TH                       i2c0
+
+#ifdef I2C_DUAL_BUS
+#define SENSOR_I2C_PB                       i2c1
+#else
+#define SENSOR_I2C_PB                       i2c0
+#endif
+
+#define SENSOR_I2C_TH_DEVICES               2
+
 weather_packet_t *  getWeatherPacket();
 int                 initSensors(i2c_inst_t * i2c);
 void                taskI2CSensor(PTASKPARM p);
+void                sensorResetCycle(void);
 
 #endif
@@ -3,6 +3,7 @@
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
 #include "serial_rp2040.h"
+#include "clock_rp2040.h"
 
 #include "gpio_def.h"
 
@@ -10,11 +11,11 @@ void initSerial(uart_inst_t * uart) {
     gpio_set_function(DEBUG_PIN_TX, GPIO_FUNC_UART);
     gpio_set_function(DEBUG_PIN_RX, GPIO_FUNC_UART);
 
-	uart_init(uart, 115200);
+	clockUARTInit(uart, 115200);
 }
 
 void deinitSerial(uart_inst_t * uart) {
-    uart_deinit(uart);
+    clockUARTDeinit(uart);
 
     gpio_set_function(DEBUG_PIN_TX, GPIO_FUNC_SIO);
     gpio_set_function(DEBUG_PIN_RX, GPIO_FUNC_SIO);
@@ -6,16 +6,110 @@
 
 #include "hardware/watchdog.h"
 #include "taskdef.h"
+#include "logger.h"
+#include "persist.h"
+#include "crash.h"
 #include "watchdog.h"
 
-static bool         doUpdate = true;
+typedef struct {
+    uint16_t                taskID;
+    rtc_t                   maxInterval;
+    volatile rtc_t          lastCheckIn;
+}
+watchdog_task_t;
+
+static watchdog_task_t      tasks[WATCHDOG_MAX_TASKS];
+static int                  taskCount = 0;
+static bool                 doUpdate = true;
+
+static watchdog_task_t * _findTask(uint16_t taskID) {
+    int                 i;
+
+    for (i = 0;i < taskCount;i++) {
+        if (tasks[i].taskID == taskID) {
+            return &tasks[i];
+        }
+    }
+
+    return NULL;
+}
 
 void triggerWatchdogReset(void) {
+    persistSaveScratch();
+
     doUpdate = false;
 }
 
+/*
+** Register a task that must check in at least every maxInterval ticks,
+** calling this again changes the interval & counts as a check in...
+*/
+void watchdogRegisterTask(uint16_t taskID, rtc_t maxInterval) {
+    watchdog_task_t *   t;
+
+    t = _findTask(taskID);
+
+    if (t == NULL) {
+        if (taskCount >= WATCHDOG_MAX_TASKS) {
+            lgLogError("Too many watchdog tasks");
+            return;
+        }
+
+        t = &tasks[taskCount++];
+        t->taskID = taskID;
+    }
+
+    t->maxInterval = maxInterval;
+    t->lastCheckIn = getRTCClock();
+}
+
+void watchdogCheckIn(uint16_t taskID) {
+    watchdog_task_t *   t;
+
+    t = _findTask(taskID);
+
+    if (t != NULL) {
+        t->lastCheckIn = getRTCClock();
+    }
+}
+
+/*
+** Nothing checks in while we're asleep, so start again when we wake...
+*/
+void watchdogResetCheckIns(void) {
+    rtc_t               now;
+    int                 i;
+
+    now = getRTCClock();
+
+    for (i = 0;i < taskCount;i++) {
+        tasks[i].lastCheckIn = now;
+    }
+}
+
+/*
+** Only feed the hardware watchdog if every task has checked in on time, 
+** otherwise record the task that stalled and let the watchdog reset us...
+*/
 void taskWatchdog(PTASKPARM p) {
-    if (doUpdate) {
-        watchdog_update();
+    rtc_t               now;
+    int                 i;
+
+    if (!doUpdate) {
+        return;
     }
+
+    now = getRTCClock();
+
+    for (i = 0;i < taskCount;i++) {
+        if ((now - tasks[i].lastCheckIn) > tasks[i].maxInterval) {
+            lgLogError("Task 0x%04X has stalled", (int)tasks[i].taskID);
+
+            crashRecordStalledTask(tasks[i].taskID);
+            triggerWatchdogReset();
+            return;
+        }
+    }
+
+    watchdog_update();
 }
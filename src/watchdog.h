@@ -3,7 +3,15 @@
 #ifndef __INCL_WATCHDOG
 #define __INCL_WATCHDOG
 
+/*
+** The most tasks that can check in with the watchdog...
+*/
+#define WATCHDOG_MAX_TASKS                  6
+
 void triggerWatchdogReset(void);
+void watchdogRegisterTask(uint16_t taskID, rtc_t maxInterval);
+void watchdogCheckIn(uint16_t taskID);
+void watchdogResetCheckIns(void);
 void taskWatchdog(PTASKPARM p);
 
 #endif